@@ -0,0 +1,106 @@
+///////////////////////////////////////////////////////
+// Barrier implementation
+// A barrier is created for a number of processes; each process
+// calling barrier_wait waits until that many processes have
+// arrived, and the last one to arrive wakes up all of them in one
+// pass over the wait queue. The barrier is then ready for the next
+// round, so a phased computation needs one system call per process
+// and phase
+// Barriers are kept in a handle table (see handle.c) like mutexes
+// and semaphores; using a barrier that does not exist is harmless
+
+#include "kernel_only.h"
+
+HANDLE_TABLE barriers;	// the barriers
+
+/*** Initialize barrier table ***/
+void init_barriers() {
+	init_handle_table(&barriers, sizeof(BARRIER));
+}
+
+/*** Barrier with a given key ***/
+// Returns NULL if there is no such barrier
+BARRIER *get_barrier(barrier_t key) {
+	return (BARRIER *)get_object(&barriers, key);
+}
+
+/*** Create a barrier object ***/
+// <count> processes have to arrive before they can go on; returns 0
+// if count is 0 or no memory is available for a new barrier
+barrier_t barrier_create(uint32_t count, PCB *p) {
+	BARRIER *b;
+
+	if (count == 0) return 0;
+
+	b = (BARRIER *)alloc_object(&barriers, p, &p->barrier.created);
+	if (b == NULL) return 0;
+
+	b->count = count;
+	b->rounds = 0;
+	init_queue(&b->waitq);
+	return object_handle(&b->h);
+}
+
+/*** Destroy a barrier with a given key ***/
+// This should be called by the process who created the barrier;
+// processes still waiting on it are woken up with BARRIER_ERROR.
+// The barrier is automatically destroyed if the creator dies
+void barrier_destroy(barrier_t key, PCB *p) {
+	BARRIER *b = get_barrier(key);
+	PCB *q;
+
+	if (b == NULL || b->h.creator != p->pid) return;
+
+	while ((q = dequeue(&b->waitq)) != NULL) {
+		q->barrier.wait_on = 0;
+		q->cpu.edx = BARRIER_ERROR; // return value
+		q->state = READY;
+	}
+	free_object(&barriers, &b->h, &p->barrier.created);
+}
+
+/*** Wait at a barrier ***/
+// Returns FALSE if process p has to wait for others to arrive;
+// the return value of the system call is set here: BARRIER_SERIAL
+// for the last process to arrive (exactly one per round), 0 for
+// the others, BARRIER_ERROR if there is no such barrier
+bool barrier_wait(barrier_t key, PCB *p) {
+	BARRIER *b = get_barrier(key);
+	PCB *q;
+
+	if (b == NULL) {
+		p->cpu.edx = BARRIER_ERROR; // return value
+		return TRUE;
+	}
+
+	if (b->waitq.count + 1 < b->count) {
+		enqueue(&b->waitq, &p->barrier.wait_node);
+		p->barrier.wait_on = key;
+		p->cpu.edx = 0; // return value when woken up
+		return FALSE;
+	}
+
+	// last one to arrive: release everybody
+	while ((q = dequeue(&b->waitq)) != NULL) {
+		q->barrier.wait_on = 0;
+		q->state = READY;
+	}
+	b->rounds++;
+	p->cpu.edx = BARRIER_SERIAL; // return value
+	return TRUE;
+}
+
+/*** Cleanup barriers for a process ***/
+// A process that dies while waiting no longer counts as arrived
+void free_barriers(PCB *p) {
+	BARRIER *b;
+
+	if (p->barrier.wait_on != 0) {
+		b = get_barrier(p->barrier.wait_on);
+		if (b != NULL) remove_queue_item(&b->waitq, &p->barrier.wait_node);
+		p->barrier.wait_on = 0;
+	}
+
+	while (p->barrier.created != 0)
+		barrier_destroy(object_handle(object_at(&barriers, p->barrier.created)), p);
+}
@@ -0,0 +1,248 @@
+///////////////////////////////////////////////////////
+// Disk block cache
+// Sectors read from disk are kept in CACHE_BLOCKS blocks of kernel
+// memory, one page (CACHE_BLOCK_SECTORS sectors) per block; a block
+// holds the sectors of an aligned run of the disk, and a bitmask
+// tells which of them have been read. Blocks are found through a
+// hash table by first LBA, and the least recently used one is
+// reused when a new block is needed
+// Programs are loaded through the cache: an image whose sectors are
+// all in the cache is copied into its frames without a disk read
+// (see load_image), and an image read from disk is put in the cache
+// (see image_loaded), so running the same program again does not
+// wait for the disk. The console reads sectors with read_disk_cached
+// The disk is never written, so cached sectors never become stale
+
+#include "kernel_only.h"
+
+extern uint32_t total_sectors;	// in disk.c
+
+CACHE_BLOCK cache_blocks[CACHE_BLOCKS];	// the cache blocks
+CACHE_BLOCK *cache_table[CACHE_BUCKETS];	// blocks by first LBA (hash chains)
+CACHE_BLOCK *cache_mru = NULL;		// most recently used block
+CACHE_BLOCK *cache_lru = NULL;		// least recently used block (reused first)
+uint32_t cache_size = 0;		// blocks with memory (at most CACHE_BLOCKS)
+CACHE_STATS cache_stats;		// hits and misses (in sectors)
+uint8_t *cache_buffer;			// disk reads of read_disk_cached go here first
+
+/*** Initialize the block cache ***/
+// Allocates the memory of the blocks; the cache is smaller than
+// CACHE_BLOCKS if kernel memory runs out
+void init_cache() {
+	int i;
+
+	for (i=0; i<CACHE_BUCKETS; i++) cache_table[i] = NULL;
+
+	cache_buffer = (uint8_t *)alloc_kernel_pages(1);
+	if (cache_buffer == NULL) return; // no cache
+
+	for (i=0; i<CACHE_BLOCKS; i++) {
+		cache_blocks[i].data = (uint8_t *)alloc_kernel_pages(1);
+		if (cache_blocks[i].data == NULL) break;
+
+		cache_blocks[i].valid = 0; // empty blocks are not in the hash table
+		cache_blocks[i].hash_next = NULL;
+		cache_blocks[i].newer = (i == 0)? NULL : &cache_blocks[i-1];
+		cache_blocks[i].older = NULL;
+		if (i > 0) cache_blocks[i-1].older = &cache_blocks[i];
+		cache_size++;
+	}
+	if (cache_size > 0) {
+		cache_mru = &cache_blocks[0];
+		cache_lru = &cache_blocks[cache_size-1];
+	}
+
+	reset_cache_stats();
+}
+
+/*** Reset the hit and miss counters ***/
+void reset_cache_stats() {
+	cache_stats.hits = 0;
+	cache_stats.misses = 0;
+	cache_stats.evictions = 0;
+}
+
+/*** Empty the cache ***/
+// Called with interrupts disabled
+void flush_cache() {
+	uint32_t i;
+
+	for (i=0; i<CACHE_BUCKETS; i++) cache_table[i] = NULL;
+	for (i=0; i<cache_size; i++) {
+		cache_blocks[i].valid = 0;
+		cache_blocks[i].hash_next = NULL;
+	}
+}
+
+/*** Number of blocks holding sectors ***/
+uint32_t cache_blocks_used() {
+	uint32_t i, n = 0;
+
+	for (i=0; i<cache_size; i++)
+		if (cache_blocks[i].valid != 0) n++;
+	return n;
+}
+
+/*** Block of the cache holding sectors from <first> on ***/
+// <first> is a multiple of CACHE_BLOCK_SECTORS; NULL if there is
+// no such block
+CACHE_BLOCK *find_cache_block(uint32_t first) {
+	CACHE_BLOCK *b;
+
+	for (b=cache_table[(first/CACHE_BLOCK_SECTORS) % CACHE_BUCKETS]; b!=NULL; b=b->hash_next)
+		if (b->LBA == first) return b;
+	return NULL;
+}
+
+/*** Make a block the most recently used one ***/
+void touch_cache_block(CACHE_BLOCK *b) {
+	if (b == cache_mru) return;
+
+	// remove from the LRU list
+	b->newer->older = b->older;
+	if (b->older != NULL) b->older->newer = b->newer;
+	else cache_lru = b->newer;
+
+	// insert at the front
+	b->newer = NULL;
+	b->older = cache_mru;
+	cache_mru->newer = b;
+	cache_mru = b;
+}
+
+/*** Block of the cache for sectors from <first> on ***/
+// The block already holding them, or else the least recently used
+// block, emptied and given to them. The block becomes the most
+// recently used one
+CACHE_BLOCK *get_cache_block(uint32_t first) {
+	CACHE_BLOCK *b = find_cache_block(first);
+	CACHE_BLOCK **q;
+
+	if (b == NULL) {
+		b = cache_lru;
+		if (b->valid != 0) { // remove from the hash table
+			q = &cache_table[(b->LBA/CACHE_BLOCK_SECTORS) % CACHE_BUCKETS];
+			while (*q != b) q = &(*q)->hash_next;
+			*q = b->hash_next;
+			cache_stats.evictions++;
+		}
+		b->LBA = first;
+		b->valid = 0;
+		b->hash_next = cache_table[(first/CACHE_BLOCK_SECTORS) % CACHE_BUCKETS];
+		cache_table[(first/CACHE_BLOCK_SECTORS) % CACHE_BUCKETS] = b;
+	}
+
+	touch_cache_block(b);
+	return b;
+}
+
+/*** Cached copy of a sector ***/
+// NULL if sector <LBA> is not in the cache
+uint8_t *cached_sector(uint32_t LBA) {
+	CACHE_BLOCK *b = find_cache_block(LBA - LBA % CACHE_BLOCK_SECTORS);
+
+	if (b == NULL || (b->valid & (1 << (LBA % CACHE_BLOCK_SECTORS))) == 0)
+		return NULL;
+	return b->data + (LBA % CACHE_BLOCK_SECTORS) * 512;
+}
+
+/*** Put a sector read from disk in the cache ***/
+void cache_sector(uint32_t LBA, uint8_t *data) {
+	CACHE_BLOCK *b = get_cache_block(LBA - LBA % CACHE_BLOCK_SECTORS);
+	uint32_t *to = (uint32_t *)(b->data + (LBA % CACHE_BLOCK_SECTORS) * 512);
+	int i;
+
+	for (i=0; i<128; i++) to[i] = ((uint32_t *)data)[i];
+	b->valid |= 1 << (LBA % CACHE_BLOCK_SECTORS);
+}
+
+/*** Read sectors through the cache ***/
+// Same as read_disk, but sectors in the cache are copied from it;
+// on a miss the whole block of the sector is read from disk and put
+// in the cache. Interrupts are disabled while the cache is used,
+// since loads of programs use it from the disk interrupt handler
+uint8_t read_disk_cached(uint32_t LBA, uint8_t n_sectors, uint8_t *buffer) {
+	uint32_t sectors_to_read = (n_sectors==0)?256:n_sectors;
+	uint32_t first, count;
+	uint32_t i, j;
+	uint8_t *sector;
+	uint8_t status;
+
+	if (cache_size == 0) return read_disk(LBA, n_sectors, buffer); // no cache
+
+	if (LBA >= total_sectors) return DISK_ERROR_LBA_OUTSIDE_RANGE;
+	if (sectors_to_read > total_sectors - LBA) return DISK_ERROR_SECTORCOUNT_TOO_BIG;
+
+	for (i=0; i<sectors_to_read; i++, LBA++, buffer+=512) {
+		disable_interrupts();
+		sector = cached_sector(LBA);
+		if (sector == NULL) {
+			enable_interrupts();
+			cache_stats.misses++;
+
+			first = LBA - LBA % CACHE_BLOCK_SECTORS;
+			count = total_sectors - first;
+			if (count > CACHE_BLOCK_SECTORS) count = CACHE_BLOCK_SECTORS;
+			status = read_disk(first, (uint8_t)count, cache_buffer);
+			if (status != NO_ERROR) return status;
+
+			disable_interrupts();
+			for (j=0; j<count; j++) cache_sector(first+j, cache_buffer+j*512);
+			sector = cache_buffer + (LBA-first)*512;
+		}
+		else {
+			cache_stats.hits++;
+			touch_cache_block(find_cache_block(LBA - LBA % CACHE_BLOCK_SECTORS));
+		}
+
+		for (j=0; j<128; j++) ((uint32_t *)buffer)[j] = ((uint32_t *)sector)[j];
+		enable_interrupts();
+	}
+
+	return NO_ERROR;
+}
+
+/*** Read sectors from the cache into frames ***/
+// Copies <n_sectors> sectors from <LBA> on into <frames>, 8 sectors
+// per frame (as a DISK_REQUEST), if all of them are in the cache;
+// returns FALSE otherwise, and nothing is copied. Called with
+// interrupts disabled
+bool cache_read_frames(uint32_t LBA, uint32_t n_sectors, uint32_t *frames) {
+	uint32_t i, j;
+	uint8_t *sector;
+	uint32_t *to = NULL;
+
+	for (i=0; i<n_sectors; i++) {
+		if (cached_sector(LBA+i) == NULL) {
+			cache_stats.misses += n_sectors; // all read from disk
+			return FALSE;
+		}
+	}
+
+	for (i=0; i<n_sectors; i++) {
+		if (i % 8 == 0) to = (uint32_t *)map_frame(frames[i/8]);
+		sector = cached_sector(LBA+i);
+		for (j=0; j<128; j++) to[(i%8)*128+j] = ((uint32_t *)sector)[j];
+		if (i == 0 || (LBA+i) % CACHE_BLOCK_SECTORS == 0)
+			touch_cache_block(find_cache_block((LBA+i) - (LBA+i) % CACHE_BLOCK_SECTORS));
+	}
+	cache_stats.hits += n_sectors;
+
+	return TRUE;
+}
+
+/*** Put sectors read into frames in the cache ***/
+// The reverse of cache_read_frames, after a disk read into <frames>;
+// a run of sectors larger than the cache is not put in it, since it
+// would only push out everything else. Called with interrupts disabled
+void cache_write_frames(uint32_t LBA, uint32_t n_sectors, uint32_t *frames) {
+	uint32_t i;
+	uint8_t *page = NULL;
+
+	if (n_sectors + CACHE_BLOCK_SECTORS > cache_size * CACHE_BLOCK_SECTORS) return;
+
+	for (i=0; i<n_sectors; i++) {
+		if (i % 8 == 0) page = (uint8_t *)map_frame(frames[i/8]);
+		cache_sector(LBA+i, page + (i%8)*512);
+	}
+}
@@ -0,0 +1,113 @@
+///////////////////////////////////////////////////////
+// Condition variable implementation
+// This implementation provides condition variables for use by user
+// processes; a condition variable is specified using a 32-bit handle
+// (called key) from the condition variable handle table (see
+// handle.c), which grows as more condition variables are created
+// A condition variable is always used together with a mutex (see
+// mutex.c): waiting atomically releases the mutex, and a woken up
+// process obtains the mutex again before it continues
+// Using a condition variable that has not been created (or has been
+// destroyed) is harmless; the functions always return in such cases
+
+#include "kernel_only.h"
+
+HANDLE_TABLE conditions;	// the condition variables
+
+/*** Initialize condition variable table ***/
+void init_conditions() {
+	init_handle_table(&conditions, sizeof(COND));
+}
+
+/*** Condition variable with a given key ***/
+// Returns NULL if there is no such condition variable
+COND *get_cond(cond_t key) {
+	return (COND *)get_object(&conditions, key);
+}
+
+/*** Create a condition variable ***/
+// The function returns 0 if no memory is available for a new
+// condition variable; otherwise the key is returned
+cond_t cond_create(PCB *p) {
+	COND *c = (COND *)alloc_object(&conditions, p, &p->cond.created);
+
+	if (c == NULL) return 0;
+
+	init_queue(&c->waitq);
+	return object_handle(&c->h);
+}
+
+/*** Destroy a condition variable with a given key ***/
+// This should be called by the process who created the condition
+// variable; condition variable is automatically destroyed if
+// creator process dies. Processes still waiting on it are woken
+// up as by cond_broadcast
+void cond_destroy(cond_t key, PCB *p) {
+	COND *c = get_cond(key);
+
+	if (c == NULL || c->h.creator != p->pid) return;
+
+	cond_broadcast(key);
+	free_object(&conditions, &c->h, &p->cond.created);
+}
+
+/*** Wait on a condition variable ***/
+// Process p must hold mutex number <m>; the mutex is released
+// and p is queued. Returns FALSE if p does not hold the mutex or
+// the condition variable does not exist (p does not wait in this case)
+bool cond_wait(cond_t key, mutex_t m, PCB *p) {
+	COND *c = get_cond(key);
+
+	if (c == NULL || !mutex_holder(m, p)) return FALSE;
+
+	enqueue(&c->waitq, &p->cond.wait_node);
+	p->cond.wait_on = key;
+	p->cond.mutex = m;
+
+	mutex_unlock(m, p);
+	return TRUE;
+}
+
+/*** Wake up one process waiting on a condition variable ***/
+// The process runs again once it has obtained its mutex
+void cond_signal(cond_t key) {
+	COND *c = get_cond(key);
+	PCB *next_p;
+
+	if (c == NULL) return;
+
+	next_p = dequeue(&c->waitq);
+	if (next_p == NULL) return; // nobody waiting
+
+	next_p->cond.wait_on = 0;
+	if (mutex_lock(next_p->cond.mutex, next_p)) // otherwise waits on the mutex
+		next_p->state = READY;
+}
+
+/*** Wake up all processes waiting on a condition variable ***/
+void cond_broadcast(cond_t key) {
+	COND *c = get_cond(key);
+
+	if (c == NULL) return;
+
+	while (c->waitq.count != 0)
+		cond_signal(key);
+}
+
+/*** Cleanup condition variables for a process ***/
+// Only the condition variables created by p are visited; p leaves
+// the wait queue it is in first, so that destroying them does not
+// wake it up
+void free_conditions(PCB *p) {
+	COND *c;
+
+	// remove from wait queue, if any
+	if (p->cond.wait_on != 0) {
+		c = get_cond(p->cond.wait_on);
+		if (c != NULL) remove_queue_item(&c->waitq, &p->cond.wait_node);
+		p->cond.wait_on = 0;
+	}
+
+	while (p->cond.created != 0)
+		cond_destroy(object_handle(object_at(&conditions, p->cond.created)), p);
+}
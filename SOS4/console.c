@@ -8,6 +8,14 @@
 #include "kernel_only.h"
 
 extern PCB *processq_next; 	// in scheduler.c
+extern uint32_t total_frames;	// in pmemman.c
+extern HANDLE_TABLE mutexes;	// in mutex.c
+extern HANDLE_TABLE semaphores;	// in semaphore.c
+extern uint32_t total_sectors;	// in disk.c
+extern uint32_t multiple_sectors;	// in disk.c
+extern bool disk_dma;		// in disk.c
+extern uint32_t cache_size;	// in cache.c
+extern CACHE_STATS cache_stats;	// in cache.c
 
 char prompt[32] = {"% "};	// the command prompt
 
@@ -75,7 +83,8 @@ bool is_pos_number(char *s) {
 /*** diskdump Command ***/
 // Format: diskdump [start LBA] [sector count]
 // Displays content of <sector count> number of sectors
-// starting from <start LBA>
+// starting from <start LBA>; sectors are read through the
+// block cache
 void command_diskdump(char *args) {
 	uint8_t a_sector[512];
 	uint8_t status;
@@ -110,7 +119,7 @@ void command_diskdump(char *args) {
 
 	// read one sector at a time and display
 	for (; n_sectors>0; n_sectors--,LBA++) {
-		status = read_disk(LBA,1,a_sector);
+		status = read_disk_cached(LBA,1,a_sector); // in cache.c
 		
 		if (status == DISK_ERROR_LBA_OUTSIDE_RANGE
 			|| status == DISK_ERROR_SECTORCOUNT_TOO_BIG) {
@@ -143,7 +152,7 @@ void command_ps() {
 		return;
 	}
 
-	puts("PID\tState\tPgDir\tText\tStack\tHeap\n");
+	puts("PID\tState\tPrio\tPgDir\tText\tStack\tHeap\n");
 	do {
 		sys_printf("%d\t",p->pid);
 		switch(p->state) {
@@ -154,8 +163,10 @@ void command_ps() {
 			case 4: s = 'T'; break; // terminated
 		}
 		
-		sys_printf("%c\t%x\t%x\t%x\t%x\n",
+		sys_printf("%c\t%d/%d\t%x\t%x\t%x\t%x\n",
 					s,
+					p->priority.base,
+					p->priority.effective,
 					p->mem.page_directory,	
 					(p->mem.end_code - p->mem.start_code + 1),
 					(p->mem.start_stack - p->cpu.esp),
@@ -164,42 +175,367 @@ void command_ps() {
 	} while (p != begin_queue);
 }
 
+/*** lockstat Command ***/
+// Lists the LOCKSTAT_TOP mutexes and semaphores that were obtained
+// after waiting most often (ties: longer total waiting time first);
+// waiting times are in epochs
+void command_lockstat() {
+	OBJECT_HEADER *top[LOCKSTAT_TOP];	// listed objects, most contended first
+	LOCK_STATS *top_stats[LOCKSTAT_TOP];	// their statistics
+	bool top_mutex[LOCKSTAT_TOP];		// mutex or semaphore?
+	uint32_t n = 0;
+	uint32_t i, j, k, slot;
+	HANDLE_TABLE *t;
+	OBJECT_HEADER *o;
+	LOCK_STATS *s;
+	PCB *holder;
+
+	for (k=0; k<2; k++) {
+		t = (k == 0)? &mutexes : &semaphores;
+		for (slot=1; slot<t->n_slots; slot++) {
+			o = object_at(t, slot);
+			s = (k == 0)? &((MUTEX *)o)->stats : &((SEMAPHORE *)o)->stats;
+			if (o->available || s->acquired == 0) continue;
+
+			// insert into sorted list, dropping the last one if full
+			for (i=n; i>0; i--) {
+				if (top_stats[i-1]->contended > s->contended ||
+				    (top_stats[i-1]->contended == s->contended && 
+				     top_stats[i-1]->wait_total >= s->wait_total))
+					break;
+			}
+			if (i == LOCKSTAT_TOP) continue;
+			if (n < LOCKSTAT_TOP) n++;
+			for (j=n-1; j>i; j--) {
+				top[j] = top[j-1];
+				top_stats[j] = top_stats[j-1];
+				top_mutex[j] = top_mutex[j-1];
+			}
+			top[i] = o;
+			top_stats[i] = s;
+			top_mutex[i] = (k == 0);
+		}
+	}
+
+	if (n == 0) {
+		puts("lockstat: No mutex or semaphore in use.\n");
+		return;
+	}
+
+	puts("Object\t\tCreator\tHolder\tAcq\tCont\tWaitTot\tWaitMax\n");
+	for (i=0; i<n; i++) {
+		if (top_mutex[i]) {
+			holder = ((MUTEX *)top[i])->lock_with;
+			sys_printf("mutex %x\t%u\t", object_handle(top[i]), top[i]->creator);
+			if (holder == NULL) puts("-\t");
+			else sys_printf("%u\t", holder->pid);
+		}
+		else {
+			sys_printf("sem %x\t%u\tv=%u\t", object_handle(top[i]), top[i]->creator,
+				((SEMAPHORE *)top[i])->value);
+		}
+		sys_printf("%u\t%u\t%u\t%u\n", top_stats[i]->acquired, top_stats[i]->contended,
+			top_stats[i]->wait_total, top_stats[i]->wait_max);
+	}
+}
+
+/*** cachestat Command ***/
+// Format: cachestat [flush]
+// Shows the use of the block cache and the hits and misses (in
+// sectors) since the start or the last flush; flush also empties
+// the cache
+void command_cachestat(char *args) {
+	uint32_t accesses;
+
+	if (*args != 0) {
+		if (strcmp(args,"flush") != 0) {
+			puts("Usage: cachestat [flush]\n");
+			return;
+		}
+		disable_interrupts(); // program loads use the cache
+		flush_cache();
+		reset_cache_stats();
+		enable_interrupts();
+		puts("cachestat: Cache flushed.\n");
+		return;
+	}
+
+	accesses = cache_stats.hits + cache_stats.misses;
+	sys_printf("Blocks: %u of %u in use (%u sectors each)\n",cache_blocks_used(),
+		cache_size,CACHE_BLOCK_SECTORS);
+	sys_printf("Hits: %u, misses: %u (%u%% hits), evictions: %u\n",cache_stats.hits,
+		cache_stats.misses,(accesses == 0)? 0 : cache_stats.hits*100/accesses,
+		cache_stats.evictions);
+}
+
+/*** diskbench Command ***/
+// Format: diskbench [sector count]
+// Reads <sector count> sectors (default 4096, i.e. 2MB) from the
+// start of the disk three times and shows the throughput of each
+// read path: polling PIO one word at a time (READ SECTORS), polling
+// PIO with READ MULTIPLE and rep insw, and a queued request served
+// by the disk interrupt handler (DMA if available). Data is read
+// into the same DISKBENCH_PAGES pages over and over; times include
+// whatever else runs meanwhile
+void command_diskbench(char *args) {
+	uint8_t *buffer;
+	uint32_t *frames;
+	uint32_t n_sectors = 4096, n_frames, frame_pages;
+	uint32_t LBA, count, start, ms[3];
+	uint8_t status = NO_ERROR;
+	volatile bool done;
+	DISK_REQUEST r;
+	uint32_t i, mode;
+
+	if (*args != 0) {
+		if (!is_pos_number(args) || atoi(args) == 0 || atoi(args) > DISKBENCH_MAXSECTORS) {
+			sys_printf("diskbench: Invalid sector count (1 to %u).\n",DISKBENCH_MAXSECTORS);
+			return;
+		}
+		n_sectors = atoi(args);
+	}
+	if (n_sectors > total_sectors) n_sectors = total_sectors;
+
+	n_frames = (n_sectors+7)/8;
+	frame_pages = bytes_to_frames(n_frames*4);
+	buffer = (uint8_t *)alloc_kernel_pages(DISKBENCH_PAGES);
+	frames = (uint32_t *)alloc_kernel_pages(frame_pages);
+	if (buffer == NULL || frames == NULL) {
+		puts("diskbench: Not enough kernel memory.\n");
+		if (buffer != NULL) dealloc_frames((void *)((uint32_t)buffer-KERNEL_BASE),DISKBENCH_PAGES);
+		if (frames != NULL) dealloc_frames((void *)((uint32_t)frames-KERNEL_BASE),frame_pages);
+		return;
+	}
+
+	// polling reads, 256 sectors (or what the buffer holds) per command
+	for (mode=0; mode<2 && status==NO_ERROR; mode++) {
+		start = get_uptime();
+		for (LBA=0; LBA<n_sectors && status==NO_ERROR; LBA+=count) {
+			count = n_sectors - LBA;
+			if (count > DISKBENCH_PAGES*8) count = DISKBENCH_PAGES*8;
+			status = read_disk_mode(LBA,(uint8_t)count,buffer,
+						(mode==0)? DISK_PIO_WORDS : DISK_PIO_BLOCKS); // 256 is sent as 0
+		}
+		ms[mode] = get_uptime() - start;
+	}
+
+	// one queued request; its frames are the buffer pages, repeated
+	if (status == NO_ERROR) {
+		for (i=0; i<n_frames; i++)
+			frames[i] = (uint32_t)buffer - KERNEL_BASE + (i % DISKBENCH_PAGES)*4096;
+		r.LBA = 0;
+		r.n_sectors = n_sectors;
+		r.frames = frames;
+		r.complete = diskbench_done;
+		r.owner = (void *)&done;
+		done = FALSE;
+
+		start = get_uptime();
+		disable_interrupts();
+		submit_disk_read(&r); // in disk.c
+		enable_interrupts();
+		while (!done); // the interrupt handler completes the request
+		ms[2] = get_uptime() - start;
+		status = r.status;
+	}
+
+	dealloc_frames((void *)((uint32_t)buffer-KERNEL_BASE),DISKBENCH_PAGES);
+	dealloc_frames((void *)((uint32_t)frames-KERNEL_BASE),frame_pages);
+
+	if (status != NO_ERROR) {
+		puts("diskbench: Disk read error.\n");
+		return;
+	}
+
+	sys_printf("%u sectors (%u KB)\n",n_sectors,n_sectors/2);
+	for (i=0; i<3; i++) {
+		if (i==0) puts("PIO, word at a time:     ");
+		else if (i==1) sys_printf("PIO, %u-sector blocks:   ",(multiple_sectors!=0)?multiple_sectors:1);
+		else puts(disk_dma? "Interrupts, DMA:         " : "Interrupts, PIO:         ");
+		if (ms[i] == 0) ms[i] = 1; // 10ms resolution
+		sys_printf("%u ms, %u KB/s\n",ms[i],(n_sectors/2)*1000/ms[i]);
+	}
+}
+
+/*** diskbench request is complete ***/
+void diskbench_done(DISK_REQUEST *r) {
+	*(volatile bool *)r->owner = TRUE;
+}
+
+/*** fragtest Command ***/
+// Format: fragtest [rounds]
+// Physical memory fragmentation stress test; up to FRAGTEST_SLOTS
+// simulated programs of mixed sizes (1 to 2048 pages) are kept in
+// memory; every round one of them is killed and a new one is started
+// in its place. Shows how often the new program could be placed in
+// contiguous frames, and how often page by page (scattered) allocation
+// succeeded
+void command_fragtest(char *args) {
+	uint32_t *frames[FRAGTEST_SLOTS];	// frames of each simulated program
+	uint32_t n_frames[FRAGTEST_SLOTS];	// size of each simulated program (0 if none)
+	uint32_t rounds = 1000;
+	uint32_t contiguous_ok = 0, scattered_ok = 0;
+	uint32_t seed = get_epochs();
+	uint32_t i, r, slot, size;
+
+	if (*args != 0) {
+		if (!is_pos_number(args) || atoi(args) == 0) {
+			puts("fragtest: Invalid number of rounds.\n");
+			return;
+		}
+		rounds = atoi(args);
+	}
+
+	for (i=0; i<FRAGTEST_SLOTS; i++) {
+		n_frames[i] = 0;
+		frames[i] = (uint32_t *)alloc_kernel_pages(2); // 2048 frame addresses
+		if (frames[i] == NULL) {
+			puts("fragtest: Not enough kernel memory.\n");
+			for (; i>0; i--) dealloc_frames((void *)((uint32_t)frames[i-1]-KERNEL_BASE),2);
+			return;
+		}
+	}
+
+	for (r=0; r<rounds; r++) {
+		seed = seed*1103515245 + 12345; // pseudo-random numbers
+		slot = (seed >> 16) % FRAGTEST_SLOTS;
+		seed = seed*1103515245 + 12345;
+		size = 1 << ((seed >> 16) % 12);
+
+		disable_interrupts(); // memory manager is also used by system calls
+
+		// kill the program in the slot
+		if (n_frames[slot] != 0) {
+			dealloc_frames_scattered(frames[slot],n_frames[slot]);
+			n_frames[slot] = 0;
+		}
+
+		// start a new one
+		if (find_frames(size,1024,total_frames) != 0) contiguous_ok++;
+		if (alloc_frames_scattered(size,frames[slot])) {
+			n_frames[slot] = size;
+			scattered_ok++;
+		}
+
+		enable_interrupts();
+	}
+
+	disable_interrupts();
+	for (i=0; i<FRAGTEST_SLOTS; i++) {
+		if (n_frames[i] != 0) dealloc_frames_scattered(frames[i],n_frames[i]);
+		dealloc_frames((void *)((uint32_t)frames[i]-KERNEL_BASE),2);
+	}
+	enable_interrupts();
+
+	sys_printf("Programs started: %u\n",rounds);
+	sys_printf("Contiguous allocation: %u succeeded (%u%%)\n",contiguous_ok,contiguous_ok*100/rounds);
+	sys_printf("Scattered allocation: %u succeeded (%u%%)\n",scattered_ok,scattered_ok*100/rounds);
+}
 
 /*** run Command ***/
-// Format: run [start LBA] [sector count]
+// Format: run [start LBA] [sector count] [copies]
+//         run [start LBA] [sector count] | run [start LBA] [sector count]
+// The first form starts <copies> processes running the program (1 if
+// not given); the second form connects the output of the first
+// program to the input of the second one through a pipe
 void command_run(char *args) {
-	uint32_t LBA;
-	uint32_t n_sectors;
-	
+	uint32_t LBA[2];
+	uint32_t n_sectors[2];
+	uint32_t copies;
+	char *second = args;
+	pipe_t key;
+	bool ok;
+
+	// is there a pipe?
+	while (*second!=0 && *second!='|') second++;
+	if (*second=='|') {
+		*second = 0;	// first command ends here
+		second++;
+		while (*second==' ') second++;
+		if (second[0]!='r' || second[1]!='u' || second[2]!='n' || second[3]!=' ') {
+			puts("Usage: run [start LBA] [sector count] | run [start LBA] [sector count]\n");
+			return;
+		}
+		second += 4;	// arguments of second command
+	}
+	else second = NULL;
+
+	if (!get_run_args(args,&LBA[0],&n_sectors[0])) return;
+	if (second == NULL) {
+		copies = get_run_copies(args);
+		while (copies > 0 && run(LBA[0],n_sectors[0],0,0)) copies--;	// in runprogram.c
+		return;
+	}
+	if (!get_run_args(second,&LBA[1],&n_sectors[1])) return;
+
+	key = pipe_create();	// in pipe.c
+	if (key == 0) {
+		puts("run: No pipe available.\n");
+		return;
+	}
+
+	ok = run(LBA[0],n_sectors[0],0,key);
+	if (!ok || !run(LBA[1],n_sectors[1],key,0)) {
+		// mark the end without a process closed
+		disable_interrupts();
+		if (!ok) pipe_close(key,PIPE_WRITE_END);
+		pipe_close(key,PIPE_READ_END);
+		enable_interrupts();
+	}
+}
+
+/*** Arguments of run ***/
+// Returns FALSE (after printing a message) if <args> is not a
+// start LBA and a sector count
+bool get_run_args(char *args, uint32_t *LBA, uint32_t *n_sectors) {
 	// get start LBA
 	if (*args==0 || *args==' ') {
 		puts("Usage: run [start LBA] [sector count]\n");
-		return;
+		return FALSE;
 	}
 	if (is_pos_number(args)==FALSE) {
 		puts("run: Invalid start LBA.\n");
-		return;
+		return FALSE;
 	}
-	LBA = atoi(args);
+	*LBA = atoi(args);
 
 	// get sector count
 	while (*args!=0 && *args!=' ') args++;	// goto end of first argument
 	args++;					// second argument from next position
 	if (*args==0 || *args==' ') {
 		puts("Usage: run [start LBA] [sector count]\n");
-		return;
+		return FALSE;
 	}
 	if (!is_pos_number(args)) {
 		puts("run: Invalid sector count.\n");
-		return;
+		return FALSE;
 	}
-	n_sectors = atoi(args);
-	if (n_sectors == 0) {
+	*n_sectors = atoi(args);
+	if (*n_sectors == 0) {
 		puts("run: Invalid sector count.\n");
-		return;
+		return FALSE;
 	}
+	return TRUE;
+}
 
-	run(LBA,n_sectors);	// in runprogram.c
+/*** Number of copies given to run ***/
+// The optional third argument; returns 0 (after printing a message)
+// if it is not a number between 1 and RUN_MAXCOPIES
+uint32_t get_run_copies(char *args) {
+	uint32_t copies;
+
+	while (*args!=0 && *args!=' ') args++;	// skip start LBA
+	while (*args==' ') args++;
+	while (*args!=0 && *args!=' ') args++;	// skip sector count
+	while (*args==' ') args++;
+	if (*args==0) return 1;
+
+	copies = atoi(args);
+	if (!is_pos_number(args) || copies == 0 || copies > RUN_MAXCOPIES) {
+		sys_printf("run: Invalid number of copies (1 to %u).\n",RUN_MAXCOPIES);
+		return 0;
+	}
+	return copies;
 }
 
 /*** Process a command typed by the user ***/
@@ -214,6 +550,8 @@ uint8_t process_command(char *cmd_buffer, uint16_t cmd_length) {
 	*args = 0; // command word ends here in the buffer
 	if (i<cmd_length) args++; // arguments start next, if any
 
+	reclaim_all_processes(); // memory of terminated processes; in scheduler.c
+
 	// help
 	if (strcmp(cmd,"help")==0) {
 		if (*args != 0) puts("No such help available.\n");
@@ -236,6 +574,12 @@ uint8_t process_command(char *cmd_buffer, uint16_t cmd_length) {
 		else command_ps(); 
 	}
 
+	// lockstat: contention statistics of mutexes and semaphores
+	else if (strcmp(cmd,"lockstat")==0) {
+		if (*args != 0) puts("lockstat: What to do with the arguments?\n");
+		else command_lockstat();
+	}
+
 	// shutdown
 	else if (strcmp(cmd,"shutdown")==0) {
 		if (*args != 0) puts("shutdown: What to do with the arguments?\n");
@@ -249,8 +593,24 @@ uint8_t process_command(char *cmd_buffer, uint16_t cmd_length) {
 		if (*args != 0) puts("mem: What to do with the arguments?\n");
 		else {
 			sys_printf("Free Memory (bytes): %x\n",count_free_memory());
+			sys_printf("Frames: kernel %d, user %d, image %d, shared %d, free %d\n",
+				count_frames(FRAME_KERNEL),count_frames(FRAME_USER),
+				count_frames(FRAME_IMAGE),count_frames(FRAME_SHMEM),
+				count_frames(FRAME_FREE));
 		}	
 	}
+	// fragtest: physical memory fragmentation stress test
+	else if (strcmp(cmd,"fragtest")==0) {
+		command_fragtest(args);
+	}
+	// diskbench: disk read throughput of each read path
+	else if (strcmp(cmd,"diskbench")==0) {
+		command_diskbench(args);
+	}
+	// cachestat: block cache statistics
+	else if (strcmp(cmd,"cachestat")==0) {
+		command_cachestat(args);
+	}
 	// diskdump: see disk content on screen
 	else if (strcmp(cmd,"diskdump")==0) {
 		command_diskdump(args);	
@@ -4,11 +4,39 @@
 // as explained in http://wiki.osdev.org/ATA_PIO_Mode
 // On the real world, DMA is the preferred method
 //
-// We will use the LBA28 addressing mode 
+// We will use the LBA28 addressing mode, and LBA48 (EXT commands)
+// when the drive has it and a command goes beyond LBA28 or reads
+// more than 256 sectors; an LBA48 command reads up to 65536 sectors
+//
+// Reads for processes (program loads) are interrupt driven: a
+// request is queued with submit_disk_read, and the drive raises
+// IRQ14 each time a sector is ready; the handler copies it into the
+// frames of the request and starts the next command or request, so
+// other processes run while the disk works. read_disk is the polling
+// version used by the console; it waits for the queue to drain and
+// keeps the drive to itself (interrupts of the drive masked) while
+// it reads
+// If the IDE controller can be a PCI bus master (see init_disk_dma),
+// requests are served with DMA: a PRD table lists the destination
+// frames and the controller moves up to DISK_DMA_MAXSECTORS sectors
+// per command without the CPU; the interrupt comes once per command. PIO is used
+// when there is no such controller, and from the first DMA error on
 
 #include "kernel_only.h"
 
-uint32_t total_sectors;	// total number of LBA28 addressable sectors
+uint32_t total_sectors;	// total number of addressable sectors (LBA48 if supported)
+bool lba48 = FALSE;	// does the drive support LBA48?
+
+DISK_REQUEST *disk_queue = NULL;	// requests waiting for the disk, oldest first
+DISK_REQUEST *disk_active = NULL;	// the request being served; NULL if none
+bool disk_claimed = FALSE;		// is read_disk using the disk?
+uint32_t multiple_sectors = 0;		// sectors per READ MULTIPLE block; 0 if not supported
+
+uint16_t bm_base = 0;		// I/O ports of the bus-master IDE (primary channel); 0 if none
+PRD *prd_table = NULL;		// PRD table (one kernel page)
+bool disk_dma = FALSE;		// are requests served with DMA?
+uint32_t disk_chunk;		// sectors in the command being served
+uint32_t disk_chunk_left;	// sectors of the command not read yet (PIO)
 
 /*** Initialize the disk (get total_sectors) ***/
 // Disk I/O port address on primary ATA bus
@@ -57,18 +85,99 @@ void init_disk(void) {
 		}
 		// no. of LBA 28-bit addressable sectors
 		total_sectors = ((uint32_t)data[60] | ((uint32_t)data[61]<<16)); 
+		// LBA48 (word 83, bit 10): no. of 48-bit addressable sectors in
+		// words 100 to 103; we keep 32 bits of it (2TB)
+		if (data[83] & 0x0400) {
+			lba48 = TRUE;
+			if (data[102] != 0 || data[103] != 0) total_sectors = 0xFFFFFFFF;
+			else if (((uint32_t)data[100] | ((uint32_t)data[101]<<16)) > total_sectors)
+				total_sectors = (uint32_t)data[100] | ((uint32_t)data[101]<<16);
+		}
+		// most sectors per block of READ MULTIPLE (0: not supported)
+		multiple_sectors = data[47] & 0xFF;
 	}
 	else {
 		total_sectors = 0;
 	}
-	
+
+	// SET MULTIPLE MODE: one DRQ (and interrupt) per block of sectors
+	if (multiple_sectors != 0) {
+		port_write_byte(0x1F6, 0xE0);			// select master
+		port_write_byte(0x1F2, (uint8_t)multiple_sectors);	// sectors per block
+		port_write_byte(0x1F7, ATA_SET_MULTIPLE);
+		do {
+			status = port_read_byte(0x1F7);
+		} while (status & 0x80); // until BSY (busy) bit is cleared
+		if (status & 0x21) multiple_sectors = 0; // ERR or DF: not accepted
+	}
+
+	// register disk handler
+	// primary ATA bus generates IRQ14, which is mapped to interrupt 46 (see setup_PIC)
+	install_interrupt_handler(46,handler_disk_entry,0x0008,0x8E);
+	port_write_byte(0x3F6, 0x00);	// device control: nIEN clear (drive sends interrupts)
 }
 
-/*** Read up to 256 sectors starting from given 28-bit LBA ***/
+/*** Read up to 256 sectors starting from given LBA ***/
 // n_sectors = 0 means 256
 // buffer must be able to hold the data; otherwise overflow (DANGER!)
 // return codes: DISK_ERROR_ERR, DISK_ERROR_DF and NO_ERROR,
 //		 DISK_ERROR_LBA_OUTSIDE_RANGE, DISK_ERROR_SECTORCOUNT_TOO_BIG
+// Uses READ MULTIPLE when the drive supports it (see read_disk_mode)
+uint8_t read_disk(uint32_t LBA, uint8_t n_sectors, uint8_t *buffer) {
+	return read_disk_mode(LBA, n_sectors, buffer, DISK_PIO_BLOCKS);
+}
+
+/*** Read up to 256 sectors with a given PIO method ***/
+// DISK_PIO_WORDS: READ SECTORS, one port read per word and a wait
+//		   for DRQ per sector
+// DISK_PIO_BLOCKS: READ MULTIPLE, a wait for DRQ per block of
+//		    multiple_sectors sectors, read with rep insw (READ
+//		    SECTORS if the drive has no READ MULTIPLE)
+uint8_t read_disk_mode(uint32_t LBA, uint8_t n_sectors, uint8_t *buffer, uint8_t mode) {
+	uint8_t status;
+	int i;
+	uint32_t sectors_to_read = (n_sectors==0)?256:n_sectors;
+	uint32_t block;
+	uint16_t *data = (uint16_t *)buffer;
+
+	if (LBA >= total_sectors) return DISK_ERROR_LBA_OUTSIDE_RANGE;
+	if (sectors_to_read > total_sectors - LBA) return DISK_ERROR_SECTORCOUNT_TOO_BIG;
+
+	if (mode == DISK_PIO_BLOCKS && multiple_sectors == 0) mode = DISK_PIO_WORDS;
+	block = (mode == DISK_PIO_BLOCKS)? multiple_sectors : 1;
+
+	claim_disk();
+	issue_command(LBA, sectors_to_read, (mode == DISK_PIO_BLOCKS)? ATA_READ_MULTIPLE : ATA_READ_SECTORS);
+
+	while (sectors_to_read > 0) {
+		if (block > sectors_to_read) block = sectors_to_read; // last block may be short
+
+		status = wait_disk_data();
+		if (status != NO_ERROR) {
+			release_disk();
+			return status;
+		}
+
+		if (mode == DISK_PIO_BLOCKS) port_read_words(0x1F0, data, 256*block);
+		else {
+			for(i=0; i<256; i++) {
+				data[i] = port_read_word(0x1F0); // read one word (2 bytes)
+			}
+		}
+		data += 256*block;
+		sectors_to_read -= block;
+
+		// 400ns delay
+		port_read_byte(0x1F7); port_read_byte(0x1F7); port_read_byte(0x1F7); port_read_byte(0x1F7);
+	}
+	release_disk();
+	return NO_ERROR;
+}
+
+/*** Wait until the drive has data to transfer ***/
+// Polls the status register until BSY is clear and DRQ is set;
+// returns NO_ERROR, or DISK_ERROR_ERR/DISK_ERROR_DF if the drive
+// reports an error instead
 //
 // Meaning of bit used in status code
 // 	0:	ERR (indicates an error occurred. Send a new 
@@ -81,46 +190,251 @@ void init_disk(void) {
 //	7: 	BSY (indicates the drive is preparing to send/receive data
 //		(wait for it to clear);in case of 'hang' (it never clears),
 //		do a software reset) 
-uint8_t read_disk(uint32_t LBA, uint8_t n_sectors, uint8_t *buffer) {
+uint8_t wait_disk_data(void) {
 	uint8_t status;
-	int i;
-	uint16_t sectors_to_read;
-	uint16_t *data = (uint16_t *)buffer;
 
-	if (LBA >= total_sectors) return DISK_ERROR_LBA_OUTSIDE_RANGE;
-	if (LBA + n_sectors > total_sectors) return DISK_ERROR_SECTORCOUNT_TOO_BIG;
+	while (1) {
+		status = port_read_byte(0x1F7);
+		if (status & 0x80) continue;		// BSY: other bits are not valid yet
+		if (status & 0x01) return DISK_ERROR_ERR;	// ERR bit set
+		if (status & 0x20) return DISK_ERROR_DF;	// DF bit set
+		if (status & 0x08) return NO_ERROR;	// DRQ bit set
+	}
+}
+
+/*** Find the bus-master IDE controller ***/
+// An IDE controller (class 1, subclass 1) with bit 7 of its
+// programming interface set can do DMA; its bus-master registers
+// are at the I/O address in BAR4. Bus mastering is turned on in
+// the PCI command register. Called after init_kernel_pages
+void init_disk_dma(void) {
+	uint32_t address = pci_find_class(0x01, 0x01); // in pci.c
+	uint32_t bar4;
+
+	if (address == 0 || total_sectors == 0) return;
+	if (!(pci_read(address + PCI_CLASS) & 0x00008000)) return; // not a bus master
+
+	bar4 = pci_read(address + PCI_BAR4);
+	if (!(bar4 & 0x01)) return; // not in I/O space
+
+	prd_table = (PRD *)alloc_kernel_pages(1);
+	if (prd_table == NULL) return;
+
+	pci_write(address + PCI_COMMAND, pci_read(address + PCI_COMMAND) | 0x05); // I/O space and bus master
+	bm_base = (uint16_t)(bar4 & 0xFFFC);
+	port_write_byte(bm_base + BM_COMMAND, 0x00); // stopped
+	port_write_byte(bm_base + BM_STATUS, 0x06); // clear interrupt and error bits
+	disk_dma = TRUE;
+}
+
+/*** Send a read command ***/
+// ATA_READ_SECTORS, ATA_READ_MULTIPLE or ATA_READ_DMA for n_sectors
+// sectors (1 to 256; up to 65536 with LBA48); the LBA48 version of
+// the command is sent when needed. The drive must not be busy
+void issue_command(uint32_t LBA, uint32_t n_sectors, uint8_t command) {
+	if (lba48 && (n_sectors > 256 || LBA + n_sectors > 0x10000000)) {
+		// LBA mode (bit 6); high bytes of count and LBA go first
+		port_write_byte(0x1F6, 0x40);
+		port_write_byte(0x1F2,(uint8_t)(n_sectors>>8));	// high 8 bits of count (65536 is sent as 0)
+		port_write_byte(0x1F3,(uint8_t)(LBA>>24));	// bits 24-31 of LBA
+		port_write_byte(0x1F4,0);			// bits 32-39 of LBA
+		port_write_byte(0x1F5,0);			// bits 40-47 of LBA
+		port_write_byte(0x1F2,(uint8_t)n_sectors);	// low 8 bits of count
+		port_write_byte(0x1F3,(uint8_t)LBA);		// low 8 bits of LBA
+		port_write_byte(0x1F4,(uint8_t)(LBA>>8));	// next 8 bits of LBA
+		port_write_byte(0x1F5,(uint8_t)(LBA>>16));	// next 8 bits of LBA
+		switch (command) {
+			case ATA_READ_SECTORS: command = ATA_READ_SECTORS_EXT; break;
+			case ATA_READ_MULTIPLE: command = ATA_READ_MULTIPLE_EXT; break;
+			case ATA_READ_DMA: command = ATA_READ_DMA_EXT; break;
+		}
+		port_write_byte(0x1F7,command);			// send the command
+		return;
+	}
 
 	// LBA mode (bit 6) and highest four bits of LBA (bit 7 and 5 are always set)
 	port_write_byte(0x1F6, 0xE0 | ((LBA >> 24) & 0x0F)); 
 
 	port_write_byte(0x1F1,0x00);			// NULL byte
-	port_write_byte(0x1F2,n_sectors); 		// sector count
+	port_write_byte(0x1F2,(uint8_t)n_sectors); 	// sector count (256 is sent as 0)
 	port_write_byte(0x1F3,(uint8_t)LBA);		// low 8 bits of LBA
 	port_write_byte(0x1F4,(uint8_t)(LBA>>8));	// next 8 bits of LBA
 	port_write_byte(0x1F5,(uint8_t)(LBA>>16));	// next 8 bits of LBA
-	port_write_byte(0x1F7,0x20);			// send READ SECTORS command
+	port_write_byte(0x1F7,command);			// send the command
+}
 
-	sectors_to_read = (n_sectors==0)?256:n_sectors;
+/*** Take the disk for polling reads ***/
+// Waits (with interrupts enabled) until no request is being served;
+// interrupts of the drive are masked until release_disk
+void claim_disk(void) {
+	while (1) {
+		disable_interrupts();
+		if (disk_active == NULL && !disk_claimed) break;
+		enable_interrupts();
+	}
+	disk_claimed = TRUE;
+	port_write_byte(0x3F6, 0x02);	// device control: nIEN set
+	enable_interrupts();
+}
 
-	for (; sectors_to_read>0; sectors_to_read--) {
-		// poll for readiness
-		do {
-			status = port_read_byte(0x1F7);
-		} while (status & 0x80); // until BSY (busy) bit is cleared
-		while(1) {
-			if (status & 0x01) return DISK_ERROR_ERR; // ERR bit set
-			if (status & 0x02) return DISK_ERROR_DF;  // DF bit set
-			if (status & 0x08) break;		  // DRQ bit set
-		}
+/*** Give the disk back to queued requests ***/
+void release_disk(void) {
+	disable_interrupts();
+	port_write_byte(0x3F6, 0x00);	// device control: nIEN clear
+	disk_claimed = FALSE;
+	start_disk_request();
+	enable_interrupts();
+}
+
+/*** Queue a read request ***/
+// Called with interrupts disabled; r->complete is called (from the
+// disk interrupt handler, or right here if the request is invalid)
+// when all sectors have been read or an error occurred
+void submit_disk_read(DISK_REQUEST *r) {
+	DISK_REQUEST **q = &disk_queue;
+
+	r->done = 0;
+	r->next = NULL;
+	if (r->n_sectors == 0 || r->LBA >= total_sectors || r->n_sectors > total_sectors - r->LBA) {
+		r->status = DISK_ERROR_LBA_OUTSIDE_RANGE;
+		r->complete(r);
+		return;
+	}
+
+	while (*q != NULL) q = &(*q)->next;
+	*q = r;
+	start_disk_request();
+}
+
+/*** Start serving the next request, if the disk is free ***/
+// Called with interrupts disabled
+void start_disk_request(void) {
+	if (disk_active != NULL || disk_claimed || disk_queue == NULL) return;
+
+	disk_active = disk_queue;
+	disk_queue = disk_queue->next;
+	start_disk_command();
+}
+
+/*** Send the next command of the request being served ***/
+// At most 256 sectors per command, or 65536 with LBA48; with DMA,
+// the PRD table gets one entry per destination frame, so a command
+// reads at most DISK_DMA_MAXSECTORS (the table is one page, and
+// commands start at a frame boundary of the request)
+void start_disk_command(void) {
+	DISK_REQUEST *r = disk_active;
+	uint32_t offset, bytes, n;
+
+	disk_chunk = r->n_sectors - r->done;
+	if (disk_chunk > (lba48? 65536 : 256)) disk_chunk = lba48? 65536 : 256;
+	if (disk_dma && disk_chunk > DISK_DMA_MAXSECTORS) disk_chunk = DISK_DMA_MAXSECTORS;
+	while (port_read_byte(0x1F7) & 0x80); // until BSY (busy) bit is cleared
 
-		// read one sector
-		for(i=0; i<256; i++) {
-			data[i] = port_read_word(0x1F0); // read one word (2 bytes)
+	if (!disk_dma) {
+		disk_chunk_left = disk_chunk;
+		issue_command(r->LBA + r->done, disk_chunk,
+			      (multiple_sectors != 0)? ATA_READ_MULTIPLE : ATA_READ_SECTORS);
+		return;
+	}
+
+	offset = r->done * 512;
+	bytes = disk_chunk * 512;
+	for (n=0; bytes>0; n++) {
+		prd_table[n].addr = r->frames[offset / 4096] + offset % 4096;
+		prd_table[n].bytes = 4096 - offset % 4096;
+		if (prd_table[n].bytes > bytes) prd_table[n].bytes = bytes;
+		prd_table[n].flags = 0;
+		offset += prd_table[n].bytes;
+		bytes -= prd_table[n].bytes;
+	}
+	prd_table[n-1].flags = PRD_EOT;
+
+	port_write_long(bm_base + BM_PRDT, (uint32_t)prd_table - KERNEL_BASE);
+	port_write_byte(bm_base + BM_COMMAND, 0x08); // read, stopped
+	port_write_byte(bm_base + BM_STATUS, 0x06); // clear interrupt and error bits
+	issue_command(r->LBA + r->done, disk_chunk, ATA_READ_DMA);
+	port_write_byte(bm_base + BM_COMMAND, 0x09); // read, start
+}
+
+/*** End the request being served ***/
+void complete_disk_request(uint8_t status) {
+	DISK_REQUEST *r = disk_active;
+
+	disk_active = NULL;
+	r->status = status;
+	r->complete(r);
+	start_disk_request();
+}
+
+/*** The disk (IRQ14) handler ***/
+// With DMA, one interrupt per command; with PIO, one per block of
+// multiple_sectors sectors (one sector without READ MULTIPLE).
+// Reading the status register acknowledges the interrupt to the drive
+asm("handler_disk_entry:\n"
+	"pushal\n"
+	"pushl %ds\n"
+	"pushl %es\n"
+	"pushl %fs\n"
+	"pushl %gs\n"
+	"call disk_interrupt_handler\n"
+	"popl %gs\n"
+	"popl %fs\n"
+	"popl %es\n"
+	"popl %ds\n"
+	"popal\n"
+	"sti\n"
+	"iretl\n"
+);
+void disk_interrupt_handler() {
+	// must reset the segment selectors before
+	// accessing any kernel data
+	asm volatile ("pushl $0x10\n" "pushl $0x10\n" "pushl $0x10\n" "pushl $0x10\n"
+		      "popl %gs\n" "popl %fs\n" "popl %es\n" "popl %ds\n"); 
+
+	DISK_REQUEST *r = disk_active;
+	uint8_t status, bm_status;
+	uint32_t block;
+
+	if (r != NULL && disk_dma) {
+		bm_status = port_read_byte(bm_base + BM_STATUS);
+		if (!(bm_status & 0x04)) goto done; // not the end of the transfer
+
+		port_write_byte(bm_base + BM_COMMAND, 0x00); // stop
+		status = port_read_byte(0x1F7);
+		port_write_byte(bm_base + BM_STATUS, 0x06); // clear interrupt and error bits
+
+		if ((bm_status & 0x02) || (status & 0x21)) { // DMA failed: use PIO from now on
+			disk_dma = FALSE;
+			start_disk_command(); // same sectors again
+			goto done;
 		}
-		data += 256;
 
-		// 400ns delay
-		port_read_byte(0x1F7); port_read_byte(0x1F7); port_read_byte(0x1F7); port_read_byte(0x1F7);
+		r->done += disk_chunk;
+		if (r->done == r->n_sectors) complete_disk_request(NO_ERROR);
+		else start_disk_command();
+		goto done;
 	}
-	return NO_ERROR;
+
+	status = port_read_byte(0x1F7);
+	if (r == NULL || (status & 0x80)) goto done; // not ours, or not ready yet
+
+	if (status & 0x01) complete_disk_request(DISK_ERROR_ERR); // ERR bit set
+	else if (status & 0x20) complete_disk_request(DISK_ERROR_DF); // DF bit set
+	else if (status & 0x08) { // DRQ bit set: read one block
+		block = (multiple_sectors != 0)? multiple_sectors : 1;
+		if (block > disk_chunk_left) block = disk_chunk_left;
+		disk_chunk_left -= block;
+		for (; block>0; block--, r->done++)
+			port_read_words(0x1F0, (uint8_t *)map_frame(r->frames[r->done / 8]) + (r->done % 8) * 512, 256);
+
+		if (r->done == r->n_sectors) complete_disk_request(NO_ERROR);
+		else if (disk_chunk_left == 0) start_disk_command(); // next command
+	}
+
+done:
+	// the PICs mask interrupts when they are being serviced;
+	// notify both (IRQ14 comes through the slave) that the
+	// interrupt has been serviced
+	port_write_byte(0xA0,0x20);
+	port_write_byte(0x20,0x20);
 }
@@ -32,10 +32,34 @@ void default_exception_handler(void) {
 }
 
 /*** The page fault exception handler ***/
-// Similar to the default exception handler but
-// shows which virtual address created the fault
-void page_fault_exception_handler(void) {
+// Faults that can be resolved (e.g. write to a copy-on-write page,
+// stack growth) return to the faulting instruction; otherwise similar 
+// to the default exception handler but shows which virtual address
+// created the fault
+// The stack has (from the top): general purpose registers (PUSHAL),
+// GS, FS, ES, DS, error code, EIP, CS, EFLAGS, [ESP, SS](only if not
+// in Ring 0)
+asm("handler_page_fault_entry:\n"
+	"pushl %ds\n"
+	"pushl %es\n"
+	"pushl %fs\n"
+	"pushl %gs\n"
+	"pushal\n"
+	"pushl %esp\n"		// saved state, error code and IRET frame
+	"call page_fault_exception_handler\n"
+	"addl $4, %esp\n"
+	"popal\n"
+	"popl %gs\n"
+	"popl %fs\n"
+	"popl %es\n"
+	"popl %ds\n"
+	"addl $4, %esp\n"	// discard error code
+	"iretl\n"
+);
+void page_fault_exception_handler(uint32_t *stack) {
 	uint32_t pf_address;
+	uint32_t error_code = stack[12];
+	uint32_t esp;
 
 	// must reset the segment selectors before
 	// accessing any kernel data
@@ -49,6 +73,15 @@ void page_fault_exception_handler(void) {
 	asm volatile("movl %cr2, %eax\n");
 	asm volatile ("movl %%eax, %0\n": "=r"(pf_address));
 	
+	if (current_process != &console) {
+		// user stack pointer: saved on the IRET frame if the fault
+		// happened in Ring 3, or in the PCB during a system call
+		esp = ((stack[14] & 0x3) == 3)? stack[16] : current_process->cpu.esp;
+
+		if (resolve_page_fault(current_process, pf_address, error_code, esp)) 
+			return; // restart faulting instruction
+	}
+
 	puts("\n");
 	if (current_process == &console) {
 		sys_printf("Kernel page fault @ 0x%x...SYSTEM HALTED!!\n",pf_address);
@@ -71,5 +104,5 @@ void init_exceptions(void) {
 	for (i=0; i<32; i++) // all of these are exceptions
 		install_interrupt_handler(i,default_exception_handler,0x0008,0x8E);
 
-	install_interrupt_handler(14,page_fault_exception_handler,0x0008,0x8E);
+	install_interrupt_handler(14,handler_page_fault_entry,0x0008,0x8E);
 }
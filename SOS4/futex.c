@@ -0,0 +1,93 @@
+///////////////////////////////////////////////////////
+// Futex (fast user-space mutex) support
+// User processes implement locks on an atomic word in (shared)
+// memory, and only call the kernel when the lock is contended:
+// futex_wait puts the process to sleep if the word still has the
+// expected value, and futex_wake wakes up processes sleeping on
+// the word (see lib.c for the user side)
+// A futex is identified by the physical address of the word, so
+// processes mapping the same frame at different logical addresses
+// wait on the same futex; waiting processes are kept in one of
+// FUTEX_BUCKETS wait queues, chosen by hashing the address
+
+#include "kernel_only.h"
+
+QUEUE futex_waitq[FUTEX_BUCKETS];	// wait queues (hashed on physical address)
+
+/*** Initialize futex wait queues ***/
+void init_futexes() {
+	int i;
+	for (i=0; i<FUTEX_BUCKETS; i++) init_queue(&futex_waitq[i]);
+}
+
+/*** Wait queue of a futex ***/
+QUEUE *futex_queue(uint32_t key) {
+	return &futex_waitq[(key >> 2) % FUTEX_BUCKETS];
+}
+
+/*** Wait on a futex ***/
+// Returns TRUE if process p is queued to wait on the word at
+// logical address <addr>; FALSE if the word does not contain
+// <value> (lock changed state in the meantime) or <addr> is not
+// a valid word address of the process
+// Address space of p is the current one
+bool futex_wait(uint32_t *addr, uint32_t value, PCB *p) {
+	uint32_t key = futex_key(addr, p);
+
+	if (key == 0) return FALSE;
+	if (*addr != value) return FALSE;
+
+	enqueue(futex_queue(key), &p->futex.wait_node);
+	p->futex.wait_on = key;
+	return TRUE;
+}
+
+/*** Wake up processes waiting on a futex ***/
+// Wakes up at most <n> processes waiting on the word at logical
+// address <addr>; returns the number of processes woken up
+uint32_t futex_wake(uint32_t *addr, uint32_t n, PCB *p) {
+	uint32_t key = futex_key(addr, p);
+	uint32_t woken = 0;
+	WAIT_NODE *node, *next;
+
+	if (key == 0) return 0;
+
+	QUEUE *q = futex_queue(key);
+	for (node = q->head; node != NULL && woken < n; node = next) {
+		next = node->next;
+		if (node->p->futex.wait_on != key) continue; // another futex in the same bucket
+
+		remove_queue_item(q, node);
+		node->p->futex.wait_on = 0;
+		node->p->state = READY;
+		woken++;
+	}
+
+	return woken;
+}
+
+/*** Physical address of futex word ***/
+// Returns 0 if <addr> is not a mapped, word aligned, user address
+// of process p
+uint32_t futex_key(uint32_t *addr, PCB *p) {
+	if ((uint32_t)addr >= KERNEL_BASE || ((uint32_t)addr & 0x3) != 0) return 0;
+
+	PDE *page_directory = (PDE *)((uint32_t)p->mem.page_directory + KERNEL_BASE);
+	uint32_t pd_entry = (uint32_t)addr >> 22; // top 10 bits
+	uint32_t pt_entry = ((uint32_t)addr >> 12) & 0x000003FF; // next top 10 bits
+
+	if ((uint32_t)(page_directory[pd_entry] & PDE_PRESENT) == 0) return 0;
+	PTE *pt = (PTE *)((page_directory[pd_entry] & 0xFFFFF000) + KERNEL_BASE);
+	if ((uint32_t)(pt[pt_entry] & PTE_PRESENT) == 0 ||
+	    (uint32_t)(pt[pt_entry] & PTE_USER_SUPERVISOR) == 0) return 0;
+
+	return (pt[pt_entry] & 0xFFFFF000) | ((uint32_t)addr & 0xFFF);
+}
+
+/*** Cleanup futex wait for a process ***/
+void free_futexes(PCB *p) {
+	if (p->futex.wait_on != 0) {
+		remove_queue_item(futex_queue(p->futex.wait_on), &p->futex.wait_node);
+		p->futex.wait_on = 0;
+	}
+}
@@ -0,0 +1,113 @@
+///////////////////////////////////////////////////////
+// Handle tables
+// Kernel objects given to user processes (mutexes, semaphores) are
+// kept in a handle table and named by a 32-bit handle: the position
+// of the object in the table (low 16 bits) and a generation number
+// (high 16 bits) that changes every time the object is freed, so a
+// stale handle is not mistaken for a new object in the same slot
+// The table grows one page (chunk) at a time, up to
+// HANDLE_MAXCHUNKS pages; objects never move, so pointers into them
+// (e.g. to their wait queues) stay valid. Slot 0 is never used
+// Free objects are kept in a free list, and the objects created by
+// a process in a list whose head is kept in the PCB; so creating,
+// freeing and finding an object are O(1), and cleaning up after a
+// process only touches the objects it created
+// Every object starts with an OBJECT_HEADER
+
+#include "kernel_only.h"
+
+/*** Initialize a handle table ***/
+// Objects are <object_size> bytes long; no memory is allocated
+// until the first object is created
+void init_handle_table(HANDLE_TABLE *t, uint32_t object_size) {
+	t->object_size = object_size;
+	t->per_chunk = 4096 / object_size;
+	t->n_chunks = 0;
+	t->n_slots = 0;
+	t->free = 0;
+}
+
+/*** Object at a position in a handle table ***/
+// index must be less than t->n_slots
+OBJECT_HEADER *object_at(HANDLE_TABLE *t, uint32_t index) {
+	return (OBJECT_HEADER *)(t->chunk[index / t->per_chunk] +
+				 (index % t->per_chunk) * t->object_size);
+}
+
+/*** Add a chunk of free objects to a handle table ***/
+// Returns FALSE if the table cannot grow any more
+bool grow_handle_table(HANDLE_TABLE *t) {
+	uint8_t *chunk;
+	OBJECT_HEADER *o;
+	uint32_t i;
+
+	if (t->n_chunks == HANDLE_MAXCHUNKS) return FALSE;
+	chunk = (uint8_t *)alloc_kernel_pages(1);
+	if (chunk == NULL) return FALSE;
+
+	t->chunk[t->n_chunks++] = chunk;
+	// new slots go to the free list, lowest first; slot 0 is not used
+	for (i = t->n_slots + t->per_chunk - 1; i >= t->n_slots && i > 0; i--) {
+		o = object_at(t, i);
+		o->available = TRUE;
+		o->generation = 1;
+		o->index = i;
+		o->next = t->free;
+		t->free = i;
+	}
+	t->n_slots += t->per_chunk;
+	return TRUE;
+}
+
+/*** Allocate an object ***/
+// The object is put in the list of objects created by process p,
+// whose head is *list. Returns NULL if no memory is available
+OBJECT_HEADER *alloc_object(HANDLE_TABLE *t, PCB *p, OBJECT_LIST *list) {
+	OBJECT_HEADER *o;
+
+	if (t->free == 0 && !grow_handle_table(t)) return NULL;
+
+	o = object_at(t, t->free);
+	t->free = o->next;
+
+	o->available = FALSE;
+	o->creator = p->pid;
+	o->prev = 0;
+	o->next = *list;
+	if (*list != 0) object_at(t, *list)->prev = o->index;
+	*list = o->index;
+	return o;
+}
+
+/*** Free an object ***/
+// *list is the head of the list of objects created by the creator
+// of the object; handles of the object become invalid
+void free_object(HANDLE_TABLE *t, OBJECT_HEADER *o, OBJECT_LIST *list) {
+	if (o->prev == 0) *list = o->next;
+	else object_at(t, o->prev)->next = o->next;
+	if (o->next != 0) object_at(t, o->next)->prev = o->prev;
+
+	o->available = TRUE;
+	o->generation++;
+	if (o->generation == 0) o->generation = 1; // a handle is never 0
+	o->next = t->free;
+	t->free = o->index;
+}
+
+/*** Find an object by its handle ***/
+// Returns NULL if there is no such object (never created, or freed)
+OBJECT_HEADER *get_object(HANDLE_TABLE *t, uint32_t handle) {
+	uint32_t index = handle & 0xFFFF;
+	OBJECT_HEADER *o;
+
+	if (index == 0 || index >= t->n_slots) return NULL;
+
+	o = object_at(t, index);
+	if (o->available || o->generation != (handle >> 16)) return NULL;
+	return o;
+}
+
+/*** Handle of an object ***/
+uint32_t object_handle(OBJECT_HEADER *o) {
+	return ((uint32_t)o->generation << 16) | o->index;
+}
@@ -0,0 +1,134 @@
+///////////////////////////////////////////////////////
+// Program images
+// Processes running the same program (same LBA and sector
+// count) share the frames holding the program; the frames
+// are mapped read-only and copy-on-write in every process,
+// so pages that are never written (code) stay shared and
+// pages that are written (data) become private on first write
+// The image holds one reference to each of its frames and every
+// mapping of a frame one more; frames are returned when the last
+// process running the program is reclaimed
+// An image is read from disk by the disk interrupt handler straight
+// into its frames; processes starting the program wait (WAITING)
+// in the load queue of the image meanwhile, and others keep running
+// Images go through the block cache (see cache.c): a program run
+// again after its image was released is copied from the cache
+
+#include "kernel_only.h"
+
+IMAGE images[IMAGE_MAXNUMBER];	// the program images; maximum 256 of them
+
+/*** Initialize all program images ***/
+void init_images() {
+	int i;
+	for (i=0; i<IMAGE_MAXNUMBER; i++) {
+		images[i].refs = 0;
+		images[i].frames = NULL;
+	}
+}
+
+/*** Obtain the image of a program ***/
+// Returns the image already in memory if another process is
+// running the program; otherwise frames are allocated for a new
+// image (loaded from disk by load_image). An image whose load
+// failed is not shared, so that the program is read again. Returns
+// NULL if no image object or memory is available
+IMAGE *get_image(uint32_t LBA, uint32_t n_sectors) {
+	uint32_t i;
+	IMAGE *free_image = NULL;
+
+	for (i=0; i<IMAGE_MAXNUMBER; i++) {
+		if (images[i].refs == 0) {
+			if (free_image == NULL) free_image = &images[i];
+			continue;
+		}
+		if (images[i].LBA == LBA && images[i].n_sectors == n_sectors &&
+		    images[i].state != IMAGE_FAILED) {
+			images[i].refs++;
+			return &images[i];
+		}
+	}
+
+	if (free_image == NULL) return NULL; // all image objects in use
+
+	// frames of the image need not be contiguous; their addresses
+	// are kept in kernel memory
+	free_image->n_pages = bytes_to_frames(n_sectors*512);
+	free_image->frames = (uint32_t *)alloc_kernel_pages(bytes_to_frames(free_image->n_pages*4));
+	if (free_image->frames == NULL) return NULL;
+
+	if (!alloc_frames_scattered(free_image->n_pages, free_image->frames)) {
+		dealloc_frames((void *)((uint32_t)free_image->frames - KERNEL_BASE), 
+			       bytes_to_frames(free_image->n_pages*4));
+		return NULL;
+	}
+	for (i=0; i<free_image->n_pages; i++)
+		set_frame_type((void *)free_image->frames[i], 1, FRAME_IMAGE);
+
+	free_image->LBA = LBA;
+	free_image->n_sectors = n_sectors;
+	free_image->state = IMAGE_EMPTY;
+	init_queue(&free_image->loadq);
+	free_image->refs = 1;
+
+	return free_image;
+}
+
+/*** Load program of process p into its image ***/
+// Done only once per image; the first process to need the image
+// starts the disk read, unless the program is in the block cache
+// (copied right away). Returns the state of the image: if it is
+// IMAGE_LOADING, p has been put in the load queue and must wait
+// (see image_loaded). Called with interrupts disabled
+uint8_t load_image(PCB *p) {
+	IMAGE *image = p->mem.image;
+
+	// no disk read if the program is in the block cache
+	if (image->state == IMAGE_EMPTY &&
+	    cache_read_frames(image->LBA, image->n_sectors, image->frames)) // in cache.c
+		image->state = IMAGE_LOADED;
+
+	if (image->state == IMAGE_LOADED || image->state == IMAGE_FAILED)
+		return image->state;
+
+	enqueue(&image->loadq, &p->disk.wait_node);
+	if (image->state == IMAGE_EMPTY) {
+		image->state = IMAGE_LOADING;
+		image->request.LBA = image->LBA;
+		image->request.n_sectors = image->n_sectors;
+		image->request.frames = image->frames;
+		image->request.complete = image_loaded;
+		image->request.owner = image;
+		submit_disk_read(&image->request); // in disk.c
+	}
+	return image->state;
+}
+
+/*** Disk read of an image is complete ***/
+// Called by the disk interrupt handler; processes waiting for the
+// image become READY, or NEW again on error so that the scheduler
+// reports the error and ends them; a loaded image is put in the
+// block cache
+void image_loaded(DISK_REQUEST *r) {
+	IMAGE *image = (IMAGE *)r->owner;
+	PCB *p;
+
+	image->state = (r->status == NO_ERROR)? IMAGE_LOADED : IMAGE_FAILED;
+	if (image->state == IMAGE_LOADED)
+		cache_write_frames(r->LBA, r->n_sectors, r->frames); // in cache.c
+	while ((p = dequeue(&image->loadq)) != NULL)
+		p->state = (image->state == IMAGE_LOADED)? READY : NEW;
+}
+
+/*** Release image used by a process ***/
+// Frames are returned when no more processes use the image
+void release_image(IMAGE *image) {
+	if (image == NULL || image->refs == 0) return;
+
+	image->refs--;
+	if (image->refs == 0) {
+		dealloc_frames_scattered(image->frames, image->n_pages);
+		dealloc_frames((void *)((uint32_t)image->frames - KERNEL_BASE), 
+			       bytes_to_frames(image->n_pages*4));
+	}
+}
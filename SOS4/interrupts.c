@@ -111,7 +111,8 @@ void setup_PIC() {
 	port_write_byte (0xA1, 0x01); // ICW4: 8086 mode, normal EOI, non-buffered
 
 	// unmask interrupts we will use (clear bit)
-  	port_write_byte (0x21, 0xfc); // timer (bit 0) & keyboard (bit 1)
+  	port_write_byte (0x21, 0xf8); // timer (bit 0), keyboard (bit 1) & slave PIC (bit 2)
+	port_write_byte (0xA1, 0xbf); // primary ATA disk (IRQ14, bit 6)
 
 }
 
@@ -28,3 +28,22 @@ uint16_t port_read_word (uint16_t port) {
 void port_write_word (uint16_t port, uint16_t value) {
 	asm volatile ("outw %w0, %w1" : : "a" (value), "Nd" (port));
 }
+
+/*** Read double word (4 bytes) from port mapped device ***/
+uint32_t port_read_long (uint16_t port) {
+	uint32_t value;
+	asm volatile ("inl %w1, %0" : "=a" (value) : "Nd" (port));
+	return value;
+}
+
+/*** Write double word (4 bytes) to port mapped device ***/
+void port_write_long (uint16_t port, uint32_t value) {
+	asm volatile ("outl %0, %w1" : : "a" (value), "Nd" (port));
+}
+
+/*** Read <count> words from port mapped device into memory ***/
+// One rep insw instead of a function call per word
+void port_read_words (uint16_t port, void *buffer, uint32_t count) {
+	asm volatile ("cld\n"
+		      "rep insw" : "+D" (buffer), "+c" (count) : "d" (port) : "memory");
+}
@@ -0,0 +1,147 @@
+///////////////////////////////////////////////////////
+// Synchronous message passing between processes
+// A message is IPC_WORDS 32-bit words carried in registers ECX, EDX
+// and ESI; the kernel copies them from the saved registers of the
+// sender to those of the receiver, so a message never touches
+// memory. Processes are named by pid (see find_process)
+// Send blocks until the receiver is ready to receive, receive until
+// a message arrives; call sends and then waits for the reply of the
+// receiver (client), and reply_wait replies to a caller and waits
+// for the next message (server)
+// When an operation wakes up the other side and the calling process
+// blocks (or the woken up process has at least the same priority),
+// the kernel switches to it directly instead of running the
+// scheduler (see switch_directly), so a request/reply round trip
+// does not wait for the quanta of other processes
+
+#include "kernel_only.h"
+
+extern PCB *pid_table[];	// in scheduler.c
+
+/*** Send a message ***/
+// The message is in the saved registers of process p; if <call> is
+// TRUE, p waits for the reply of <dest> afterwards. Returns FALSE if
+// p has to wait
+bool send_message(PCB *p, uint32_t dest, bool call) {
+	PCB *d = find_process(dest);
+
+	if (d == NULL || d == p || d->state == TERMINATED) {
+		p->cpu.eax = IPC_ERROR; // return value
+		return TRUE;
+	}
+
+	if (d->ipc.state == IPC_RECEIVING && (d->ipc.partner == IPC_ANY || d->ipc.partner == p->pid)) {
+		deliver_message(p, d);
+		if (call) { // now wait for the reply
+			p->ipc.state = IPC_RECEIVING;
+			p->ipc.partner = dest;
+			switch_directly(d);
+			return FALSE;
+		}
+		p->cpu.eax = 0; // return value
+		switch_directly(d);
+		return TRUE;
+	}
+
+	// wait until d receives
+	enqueue(&d->ipc.senders, &p->ipc.wait_node);
+	p->ipc.state = IPC_SENDING;
+	p->ipc.partner = dest;
+	p->ipc.call = call;
+	return FALSE;
+}
+
+/*** Receive a message ***/
+// From process <from>, or from anybody if <from> is IPC_ANY; the
+// message is put in the saved registers of process p, and the pid of
+// the sender in EAX. Returns FALSE if p has to wait
+bool receive_message(PCB *p, uint32_t from) {
+	WAIT_NODE *n;
+	PCB *s;
+
+	for (n=p->ipc.senders.head; n!=NULL; n=n->next)
+		if (from == IPC_ANY || n->p->pid == from) break;
+
+	if (n == NULL) { // wait for a sender
+		if (from != IPC_ANY && find_process(from) == NULL) {
+			p->cpu.eax = IPC_ERROR; // return value
+			return TRUE;
+		}
+		p->ipc.state = IPC_RECEIVING;
+		p->ipc.partner = from;
+		return FALSE;
+	}
+
+	s = n->p;
+	remove_queue_item(&p->ipc.senders, n);
+	deliver_message(s, p);
+	p->state = READY;
+
+	if (s->ipc.call) { // sender now waits for the reply
+		s->ipc.state = IPC_RECEIVING;
+		s->ipc.partner = p->pid;
+	}
+	else {
+		s->ipc.state = IPC_NONE;
+		s->cpu.eax = 0; // return value
+		s->state = READY;
+	}
+	return TRUE;
+}
+
+/*** Reply to a process waiting for it ***/
+// Process <dest> must be waiting for a message from p (e.g. after a
+// call); the reply is delivered without waiting. Returns FALSE if
+// <dest> is not waiting for p
+bool reply_message(PCB *p, uint32_t dest) {
+	PCB *d = find_process(dest);
+
+	if (d == NULL || d->ipc.state != IPC_RECEIVING || d->ipc.partner != p->pid)
+		return FALSE;
+
+	deliver_message(p, d);
+	switch_directly(d);
+	return TRUE;
+}
+
+/*** Copy a message from one process to another ***/
+// Receiver <to> is woken up with the message and the sender's pid
+void deliver_message(PCB *from, PCB *to) {
+	to->cpu.ecx = from->cpu.ecx;
+	to->cpu.edx = from->cpu.edx;
+	to->cpu.esi = from->cpu.esi;
+	to->cpu.eax = from->pid; // return value: sender
+
+	to->ipc.state = IPC_NONE;
+	to->state = READY;
+}
+
+/*** Cleanup message passing for a process ***/
+// Processes waiting to send to p, or to receive from p, are woken up
+// with an error
+void free_ipc(PCB *p) {
+	PCB *q;
+	uint32_t i;
+
+	if (p->ipc.state == IPC_SENDING) {
+		q = find_process(p->ipc.partner);
+		if (q != NULL) remove_queue_item(&q->ipc.senders, &p->ipc.wait_node);
+	}
+	p->ipc.state = IPC_NONE;
+
+	while ((q = dequeue(&p->ipc.senders)) != NULL) {
+		q->ipc.state = IPC_NONE;
+		q->cpu.eax = IPC_ERROR; // return value
+		q->state = READY;
+	}
+
+	for (i=0; i<PID_BUCKETS; i++) {
+		for (q=pid_table[i]; q!=NULL; q=q->pid_next) {
+			if (q->ipc.state == IPC_RECEIVING && q->ipc.partner == p->pid) {
+				q->ipc.state = IPC_NONE;
+				q->cpu.eax = IPC_ERROR; // return value
+				q->state = READY;
+			}
+		}
+	}
+}
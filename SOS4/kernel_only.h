@@ -47,21 +47,121 @@
 #define PTE_ACCESSED		0x00000020
 #define PTE_DIRTY		0x00000040
 #define PTE_GLOBAL		0x00000100
+#define PTE_COPY_ON_WRITE	0x00000200	// available to OS (bit 9): frame shared, copy on write
+
+/*** Page fault error code ***/
+#define PF_PROTECTION		0x00000001	// page was present (else not present)
+#define PF_WRITE		0x00000002	// write access (else read)
+#define PF_USER			0x00000004	// fault in Ring 3 (else Ring 0)
+
+/*** Console ***/
+#define FRAGTEST_SLOTS	24	// programs kept in memory by the fragtest command
+#define RUN_MAXCOPIES	64	// copies of a program started by one run command
+#define DISKBENCH_PAGES	32	// buffer of the diskbench command (256 sectors)
+#define DISKBENCH_MAXSECTORS	65536	// most sectors read by diskbench (32MB)
+
+/*** Process priority ***/
+#define PRIORITY_LEVELS		8	// priorities are 0 (lowest) to 7 (highest)
+#define PRIORITY_DEFAULT	4	// priority of a new process
+
+/*** Process lookup ***/
+#define PID_BUCKETS	64	// hash chains of processes by pid (see find_process)
+
+/*** Message passing (state of a process) ***/
+#define IPC_NONE	0
+#define IPC_SENDING	1	// waiting for the receiver
+#define IPC_RECEIVING	2	// waiting for a message (or a reply)
+
+/*** Process reclaim ***/
+#define DEFERRED_RECLAIM	TRUE	// free memory of terminated processes from the console
+
+/*** Wake-up handoff ***/
+#define WAKEUP_HANDOFF	TRUE	// switch to the process woken up by an UP/unlock (see wakeup_handoff)
+
+/*** Frame types (see FRAME) ***/
+#define FRAME_FREE	0
+#define FRAME_KERNEL	1	// kernel memory (PCB, page tables, etc.)
+#define FRAME_USER	2	// private memory of a process
+#define FRAME_IMAGE	3	// program image (shared by processes)
+#define FRAME_SHMEM	4	// shared memory object
+#define FRAME_TYPES	5
+
+/*** PCI configuration space (register offsets) ***/
+#define PCI_COMMAND	0x04	// command (low 16 bits) and status
+#define PCI_CLASS	0x08	// class, subclass, programming interface, revision
+#define PCI_HEADER	0x0C	// header type (bits 16-23; bit 23: multi-function)
+#define PCI_BAR4	0x20	// base address register 4
+
+/*** ATA commands ***/
+#define ATA_READ_SECTORS	0x20	// PIO
+#define ATA_READ_MULTIPLE	0xC4	// PIO, one DRQ per block of sectors
+#define ATA_READ_DMA		0xC8	// bus-master DMA
+#define ATA_SET_MULTIPLE	0xC6	// set sectors per block of READ MULTIPLE
+#define ATA_READ_SECTORS_EXT	0x24	// LBA48 versions
+#define ATA_READ_MULTIPLE_EXT	0x29
+#define ATA_READ_DMA_EXT	0x25
+
+/*** PIO read methods (see read_disk_mode) ***/
+#define DISK_PIO_WORDS		0
+#define DISK_PIO_BLOCKS		1
+
+/*** Bus-master IDE (registers relative to BAR4) ***/
+#define BM_COMMAND	0	// bit 0: start; bit 3: read (write to memory)
+#define BM_STATUS	2	// bit 0: active; bit 1: error; bit 2: interrupt
+#define BM_PRDT		4	// physical address of the PRD table
+#define PRD_EOT		0x8000	// last entry of a PRD table
+#define DISK_DMA_MAXSECTORS	4096	// sectors per DMA command (one PRD table page of frames)
+
+/*** Block cache ***/
+#define CACHE_BLOCKS	128	// blocks in the cache (one page each; 512KB)
+#define CACHE_BLOCK_SECTORS	8	// sectors per block
+#define CACHE_BUCKETS	64	// hash chains of blocks by LBA
 
 /*** Queue status ***/
 #define Q_EMPTY		0
-#define Q_MAXSIZE 	256 // maximum number of items in queue
-#define Q_ITEM_REMOVED  0xFFFFFFFF
 
-/*** Semaphore ***/
-#define SEM_MAXNUMBER	256 // maximum number of semaphores
+/*** Handle table ***/
+#define HANDLE_MAXCHUNKS	64 // maximum number of pages in a handle table
 
-/*** Mutex ***/
-#define MUTEX_MAXNUMBER	256 // maximum number of mutexes
+/*** Pipe ***/
+#define PIPE_MAXNUMBER	64	// maximum number of pipes
+#define PIPE_BUFFER_SIZE	4096	// bytes in the ring buffer of a pipe (one page)
+#define PIPE_MAXPAGES	16	// maximum number of pages given to a pipe (zero-copy)
+
+/*** Wait on multiple objects ***/
+#define WAIT_MAXOBJECTS	8	// maximum number of objects in a wait_any set
+#define WAIT_SINGLE	0xFFFFFFFF	// index of a wait node not in a wait_any set
+
+/*** Lock statistics ***/
+#define LOCKSTAT_TOP	10	// number of objects listed by lockstat
+
+/*** Futex ***/
+#define FUTEX_BUCKETS	64 // number of futex wait queues
+
+/*** User stack ***/
+// The stack page table maps 0xBF800000 to 0xBFBFFFFF; its last page
+// is the kernel-mode stack and the user stack grows down below it. The
+// page below the largest possible stack is a guard page (never mapped)
+#define USER_STACK_TOP		0xBFBFF000	// user stack grows down from here
+#define KERNEL_TEMP_MAP		0xBFC00000	// kernel-only page to access any frame (see map_frame)
+#define USER_STACK_INIT_PAGES	1		// pages mapped when process starts
+#define USER_STACK_MAX_PAGES	256		// stack can grow up to 1MB
+
+/*** Program images ***/
+#define IMAGE_MAXNUMBER	256	// maximum number of different programs running at a time
+#define IMAGE_EMPTY	0	// not loaded yet
+#define IMAGE_LOADING	1	// being read from disk
+#define IMAGE_LOADED	2
+#define IMAGE_FAILED	3	// disk error while loading
 
 /*** Shared memory ***/
 #define SHMEM_MAXNUMBER	256 		// maximum number of shared memory objects
-#define SHM_BEGIN	0x80000000	// default shared memory start logical address
+#define SHM_BEGIN	0x80000000	// shared memory areas are mapped from here
+#define SHM_END		0xBF800000	// up to here (stack page table)
+#define SHM_MAXSIZE	0x4000000	// maximum size of an object (64MB)
+#define SHM_MAXATTACH	16		// maximum number of areas of a process
+#define SHM_NAMELEN	32		// maximum length of a name, with the terminating 0
+#define SHM_HASH_BUCKETS	1024	// hash chains of names (one page)
 
 /*** A GDT entry ***/
 typedef struct {
@@ -174,6 +274,86 @@ typedef uint32_t PDE;
 //   bit 9-11: set 0
 typedef uint32_t PTE;
 
+/*** Physical frame descriptor ***/
+typedef struct {
+	uint16_t refs;		// number of references (mappings); frame is free when zero
+	uint8_t type;		// what the frame is used for (FRAME_FREE, FRAME_KERNEL, etc.)
+	uint8_t flags;		// reserved
+	uint16_t lru_prev;	// LRU list links (frame numbers) for page replacement;
+	uint16_t lru_next;	// not used yet
+} __attribute__ ((packed)) FRAME;
+
+/*** Wait queue node (embedded in the PCB of a waiting process) ***/
+// Packed like the PCB, so that pointers to the nodes (and queues)
+// in a PCB are not assumed to be aligned
+typedef struct wait_node {
+	struct wait_node *prev, *next;		// neighbours in the wait queue
+	struct process_control_block *p;	// the waiting process
+	uint32_t index;				// position in a wait_any set; WAIT_SINGLE if not in one
+	uint32_t since;				// epoch when queued
+} __attribute__ ((packed)) WAIT_NODE;
+
+/*** Queue ***/
+typedef struct {
+	WAIT_NODE *head;	// first waiting process; NULL if queue is empty
+	WAIT_NODE *tail;	// last waiting process
+	uint32_t count;		// the number of waiting processes
+} __attribute__ ((packed)) QUEUE;
+
+/*** Disk read request (served by the disk interrupt handler) ***/
+typedef struct disk_request {
+	uint32_t LBA;		// first sector to read
+	uint32_t n_sectors;	// number of sectors to read
+	uint32_t *frames;	// frames to read into, 8 sectors per frame
+	uint32_t done;		// number of sectors read so far
+	uint8_t status;		// NO_ERROR or a disk error code, when complete
+	void (*complete)(struct disk_request *);	// called when complete (interrupts off)
+	void *owner;		// object the request is made for
+	struct disk_request *next;	// next request in the disk queue
+} DISK_REQUEST;
+
+/*** Block of the disk cache ***/
+typedef struct cache_block {
+	uint32_t LBA;		// first sector (a multiple of CACHE_BLOCK_SECTORS)
+	uint8_t valid;		// bit i set if sector LBA+i is in the block; 0 if block is empty
+	uint8_t *data;		// the sectors (one page of kernel memory)
+	struct cache_block *hash_next;	// next block in the hash chain
+	struct cache_block *newer;	// LRU list neighbours (NULL at the ends)
+	struct cache_block *older;
+} CACHE_BLOCK;
+
+/*** Disk cache statistics ***/
+typedef struct {
+	uint32_t hits;		// sectors found in the cache
+	uint32_t misses;	// sectors read from disk
+	uint32_t evictions;	// blocks reused for other sectors
+} CACHE_STATS;
+
+/*** Physical region descriptor (bus-master DMA) ***/
+typedef struct {
+	uint32_t addr;		// physical address of the region
+	uint16_t bytes;		// size of the region (0 means 64KB)
+	uint16_t flags;		// PRD_EOT in the last entry
+} __attribute__ ((packed)) PRD;
+
+/*** Program image (shared by processes running the same program) ***/
+typedef struct {
+	uint32_t refs;		// the number of processes using this image
+	uint32_t LBA;		// start sector of program in disk
+	uint32_t n_sectors;	// number of sectors of program
+	uint32_t n_pages;	// size of image in number of pages
+	uint32_t *frames;	// frame addresses of the image pages (kernel memory)
+	uint8_t state;		// IMAGE_EMPTY, IMAGE_LOADING, IMAGE_LOADED or IMAGE_FAILED
+	QUEUE loadq;		// processes waiting for the image to be loaded
+	DISK_REQUEST request;	// the disk read loading the image
+} IMAGE;
+
+/*** Shared memory area of a process ***/
+typedef struct {
+	uint32_t object;	// the shared memory object (handle table index)
+	uint32_t addr;		// logical address where it is mapped
+} SHM_ATTACHMENT;
+
 /*** Process Control Block (everything about a process) ***/
 typedef struct process_control_block {
 	struct {
@@ -201,7 +381,14 @@ typedef struct process_control_block {
 	
 	uint32_t sleep_end;
 
+	struct {
+		uint8_t base;			// priority set for the process
+		uint8_t effective;		// base raised to the highest priority waiting on a 
+						// mutex held by the process (priority inheritance)
+	} priority;
+
 	struct process_control_block *prev_PCB, *next_PCB;
+	struct process_control_block *pid_next;	// next process in the same pid hash chain
  
 
 	struct {			// all addresses are logical
@@ -210,61 +397,195 @@ typedef struct process_control_block {
 		uint32_t start_brk;	// start address of heap
 		uint32_t brk;		// current end address of heap
 		uint32_t start_stack;	// start address of stack 
+		uint32_t end_stack;	// lowest address of the mapped stack (grows on demand)
 		PDE *page_directory;	// page directory
+		IMAGE *image;		// program image (code and initial data)
 	} mem;
 
 	struct {
 		uint32_t LBA;
 		uint32_t n_sectors;
+		WAIT_NODE wait_node;	// the node in the load queue of the image while it is read
 	} disk;
 
 
-	struct {	
-		bool created;			// a process is allowed to create only one shared memory object
-		uint8_t key;			// which shared memory object is being used, if any
+	struct {
+		uint32_t n;			// number of shared memory areas attached
+		SHM_ATTACHMENT segment[SHM_MAXATTACH];	// the areas, sorted by address
 	} shared_memory;
 
 	struct {
-		int wait_on;			// the mutex on which this process is waiting; -1 if none
-		uint32_t queue_index;		// the index in the wait queue if waiting on a mutex
+		mutex_t wait_on;		// the mutex on which this process is waiting; 0 if none
+		uint32_t created;		// first mutex created by this process (handle table index); 0 if none
+		uint32_t held;			// first mutex held by this process (handle table index); 0 if none
+		WAIT_NODE wait_node;		// the node in the wait queue if waiting on a mutex
 	} mutex;
 
 	struct {
-		int wait_on;			// the semaphore on which this process is waiting; -1 if none
-		uint32_t queue_index;		// the index in the wait queue if waiting on a semaphore
+		sem_t wait_on;			// the semaphore on which this process is waiting; 0 if none
+		uint32_t created;		// first semaphore created by this process (handle table index); 0 if none
+		uint32_t count;			// how much the process is waiting to decrease the value by
+		WAIT_NODE wait_node;		// the node in the wait queue if waiting on a semaphore
 	} semaphore;
 
+	struct {
+		barrier_t wait_on;		// the barrier at which this process is waiting; 0 if none
+		uint32_t created;		// first barrier created by this process (handle table index); 0 if none
+		WAIT_NODE wait_node;		// the node in the wait queue if waiting at a barrier
+	} barrier;
+
+	struct {
+		cond_t wait_on;			// the condition variable on which this process is waiting; 0 if none
+		mutex_t mutex;			// the mutex to obtain again when woken up
+		uint32_t created;		// first condition variable created by this process (handle table index); 0 if none
+		WAIT_NODE wait_node;		// the node in the wait queue if waiting on a condition variable
+	} cond;
+
+	struct {
+		rwlock_t wait_on;		// the reader-writer lock on which this process is waiting; 0 if none
+		bool write;			// waiting to write (TRUE) or to read (FALSE)
+		uint32_t created;		// first lock created by this process (handle table index); 0 if none
+		uint32_t written;		// first lock held for writing by this process (handle table index); 0 if none
+		uint32_t reading;		// first read hold of this process (read hold table index); 0 if none
+		WAIT_NODE wait_node;		// the node in the wait queue if waiting on a reader-writer lock
+	} rwlock;
+
+	struct {
+		pipe_t in;			// pipe read from (0 if none)
+		pipe_t out;			// pipe written to (0 if none)
+		QUEUE *wait_queue;		// the pipe wait queue this process is in; NULL if none
+		WAIT_NODE wait_node;		// the node in the wait queue if waiting on a pipe
+	} pipe;
+
+	struct {
+		uint32_t wait_on;		// physical address of the futex word waited on; 0 if none
+		WAIT_NODE wait_node;		// the node in the wait queue if waiting on a futex
+	} futex;
+
+	struct {
+		uint32_t n;				// number of objects waited on; 0 if none
+		WAIT_OBJECT object[WAIT_MAXOBJECTS];	// the objects
+		QUEUE *queue[WAIT_MAXOBJECTS];		// wait queue of each object
+		WAIT_NODE node[WAIT_MAXOBJECTS];	// the node in each wait queue
+	} wait_any;
+
+	struct {
+		uint32_t state;			// IPC_NONE, IPC_SENDING or IPC_RECEIVING
+		uint32_t partner;		// pid of process sending to or receiving from (IPC_ANY: any)
+		bool call;			// waiting for the reply after sending?
+		QUEUE senders;			// processes waiting to send to this process
+		WAIT_NODE wait_node;		// the node in the senders queue of the receiver
+	} ipc;
+
 } __attribute__ ((packed)) PCB;
 
-/*** Queue ***/
+
+/*** Lock statistics ***/
+typedef struct {
+	uint32_t acquired;	// number of times obtained
+	uint32_t contended;	// number of times obtained after waiting
+	uint32_t wait_total;	// total waiting time (epochs)
+	uint32_t wait_max;	// longest waiting time (epochs)
+} LOCK_STATS;
+
+/*** Handle table ***/
+// Head of a list of objects created by a process (handle table
+// index; 0 if empty); byte-aligned, since heads are kept in the PCB
+typedef uint32_t __attribute__ ((aligned (1))) OBJECT_LIST;
+
+// Header of every object kept in a handle table (see handle.c)
 typedef struct {
-	uint32_t head;		// the head index in the data array
-	uint32_t count;		// the number of items in data array
-	uint32_t *data;		// the queue item (PCB addresses) array
-} QUEUE;
+	bool available;		// is the object free?
+	uint16_t generation;	// high 16 bits of handles of the object
+	uint16_t index;		// position in the table; low 16 bits of handles
+	uint32_t creator;	// pid of process who created the object
+	uint32_t prev;		// previous object created by the same process; 0 if none
+	uint32_t next;		// next object created by the same process, or next free one; 0 if none
+} OBJECT_HEADER;
 
+typedef struct {
+	uint32_t object_size;	// bytes in an object
+	uint32_t per_chunk;	// objects in a chunk (page)
+	uint32_t n_chunks;	// chunks allocated
+	uint32_t n_slots;	// objects in allocated chunks (including unused slot 0)
+	uint32_t free;		// first free object; 0 if none
+	uint8_t *chunk[HANDLE_MAXCHUNKS];	// the chunks
+} HANDLE_TABLE;
 
 /*** Mutex ***/
 typedef struct {
-	bool available;		// is the mutex object being used by other processes?
-	uint32_t creator;	// pid of process who created the mutex object
+	OBJECT_HEADER h;	// handle table bookkeeping; availability and creator
 	PCB *lock_with;		// PCB of process who currently owns the lock
+	uint32_t held_next;	// next mutex held by the same process (handle table index); 0 if none
 	QUEUE waitq;		// the waiting queue
+	LOCK_STATS stats;	// contention statistics
 } MUTEX;
 
 /*** Semaphore ***/
 typedef struct {
-	bool available;		// is the semaphoare object being used by other processes?
-	uint32_t creator;	// pid of process who created the semaphore object
-	int value;		// current value of semaphore
+	OBJECT_HEADER h;	// handle table bookkeeping; availability and creator
+	uint32_t value;		// current value of semaphore
 	QUEUE waitq;		// the waiting queue
+	LOCK_STATS stats;	// contention statistics
 } SEMAPHORE;
 
+/*** Barrier ***/
+typedef struct {
+	OBJECT_HEADER h;	// handle table bookkeeping; availability and creator
+	uint32_t count;		// number of processes to wait for
+	uint32_t rounds;	// number of times all processes have arrived
+	QUEUE waitq;		// the processes that have arrived
+} BARRIER;
+
+/*** Condition variable ***/
+typedef struct {
+	OBJECT_HEADER h;	// handle table bookkeeping; availability and creator
+	QUEUE waitq;		// the waiting queue
+} COND;
+
+/*** Reader-writer lock ***/
+typedef struct {
+	OBJECT_HEADER h;	// handle table bookkeeping; availability and creator
+	uint32_t readers;	// number of read holds on the lock
+	PCB *writer;		// PCB of process holding the lock for writing, if any
+	uint32_t written_next;	// next lock held for writing by the same process (handle table index); 0 if none
+	QUEUE waitq;		// the waiting queue (readers and writers)
+} RWLOCK;
+
+/*** Read hold of a reader-writer lock ***/
+typedef struct {
+	OBJECT_HEADER h;	// handle table bookkeeping; the creator is the holder
+	rwlock_t lock;		// the lock held for reading
+	uint32_t count;		// times the holder has obtained it for reading (0 while waiting)
+} READ_HOLD;
+
+/*** Pipe ***/
+typedef struct {
+	bool available;		// is the pipe object being used?
+	uint8_t *buffer;	// the ring buffer (kernel memory)
+	uint32_t head;		// position of the first byte in the ring buffer
+	uint32_t count;		// number of bytes in the ring buffer
+	uint32_t page[PIPE_MAXPAGES];	// frames given by writers (zero-copy), oldest first
+	uint32_t n_pages;	// number of frames given
+	uint32_t page_offset;	// bytes of the first frame already read
+	uint32_t readers;	// number of processes with the read end open
+	uint32_t writers;	// number of processes with the write end open
+	bool read_closed;	// all readers have gone away
+	bool write_closed;	// all writers have gone away (end of input)
+	QUEUE readq;		// processes waiting for data
+	QUEUE writeq;		// processes waiting for space
+} PIPE;
+
 /*** Shared memory ***/
 typedef struct {
-	uint32_t refs;		// the number of references to this shared memory object
-	uint32_t base;		// start frame address of shared memory area
+	OBJECT_HEADER h;	// handle table bookkeeping
+	uint32_t refs;		// the number of references (attachments and name) to this shared memory object
+	uint32_t *frames;	// frame addresses of shared memory pages (kernel memory)
 	uint32_t size;		// size (in bytes) of shared memory area
+	bool keyed;		// is the object known by a key?
+	uint8_t key;		// the key, if so
+	uint32_t hash_next;	// next object in the hash chain of the name; 0 if none
+	char name[SHM_NAMELEN];	// name of the object; empty if none
 } SHMEM;
 
 /*** main.c ***/
@@ -275,6 +596,15 @@ void port_write_byte(uint16_t, uint8_t);
 uint8_t port_read_byte(uint16_t);
 uint16_t port_read_word(uint16_t);
 void port_write_word(uint16_t, uint16_t);
+uint32_t port_read_long(uint16_t);
+void port_write_long(uint16_t, uint32_t);
+void port_read_words(uint16_t, void *, uint32_t);
+
+/*** pci.c ***/
+uint32_t pci_address(uint8_t, uint8_t, uint8_t, uint8_t);
+uint32_t pci_read(uint32_t);
+void pci_write(uint32_t, uint32_t);
+uint32_t pci_find_class(uint8_t, uint8_t);
 
 /*** display.c ***/
 void init_display(void);
@@ -314,7 +644,8 @@ __attribute__((fastcall)) void handler_syscall_0XFF(void);
 
 /*** exceptions.c ***/
 void default_exception_handler(void);
-void page_fault_exception_handler(void);
+void handler_page_fault_entry(void);
+void page_fault_exception_handler(uint32_t *);
 void init_exceptions(void);
 
 /*** kernelservices.c ***/
@@ -330,9 +661,43 @@ void _0x94_semaphore_create(void);
 void _0x94_semaphore_destroy(void);
 void _0x94_semaphore_up(void);
 void _0x94_semaphore_down(void);
+void _0x94_semaphore_down_timeout(void);
+void _0x94_semaphore_up_n(void);
+void _0x94_semaphore_down_n(void);
+void _0x94_barrier_create(void);
+void _0x94_barrier_destroy(void);
+void _0x94_barrier_wait(void);
+void _0x94_uptime(void);
+void _0x94_pipe_create(void);
+void _0x94_pipe_attach(void);
+void _0x94_pipe_detach(void);
+void _0x94_pipe_read(void);
+void _0x94_pipe_write(void);
 void _0x94_shm_create(void);
 void _0x94_shm_attach(void);
 void _0x94_shm_detach(void);
+void _0x94_shm_open(void);
+void _0x94_shm_unlink(void);
+bool copy_shm_name(char *, char *);
+void _0x94_futex_wait(void);
+void _0x94_futex_wake(void);
+void _0x94_wait_any(void);
+void _0x94_getpid(void);
+void _0x94_ipc_send(void);
+void _0x94_ipc_receive(void);
+void _0x94_ipc_call(void);
+void _0x94_ipc_reply(void);
+void _0x94_ipc_reply_wait(void);
+void _0x94_set_priority(void);
+void _0x94_cond_create(void);
+void _0x94_cond_destroy(void);
+void _0x94_cond_wait(void);
+void _0x94_cond_signal(void);
+void _0x94_cond_broadcast(void);
+void _0x94_rwlock_create(void);
+void _0x94_rwlock_destroy(void);
+void _0x94_rwlock_lock(void);
+void _0x94_rwlock_unlock(void);
 
 /*** keyboard.c ***/
 void handler_keyboard_entry(void);
@@ -348,50 +713,192 @@ void start_console(void);
 char *read_command(char *, uint16_t *);
 void command_diskdump(char *);
 void command_run(char *);
+bool get_run_args(char *, uint32_t *, uint32_t *);
+uint32_t get_run_copies(char *);
 void command_ps(void);
+void command_lockstat(void);
+void command_fragtest(char *);
+void command_diskbench(char *);
+void command_cachestat(char *);
+void diskbench_done(DISK_REQUEST *);
 uint8_t process_command(char *, uint16_t);
 
 /*** disk.c ***/
 void init_disk(void);
 uint8_t read_disk(uint32_t, uint8_t, uint8_t *);
+uint8_t read_disk_mode(uint32_t, uint8_t, uint8_t *, uint8_t);
+uint8_t wait_disk_data(void);
+void claim_disk(void);
+void release_disk(void);
+void init_disk_dma(void);
+void issue_command(uint32_t, uint32_t, uint8_t);
+void submit_disk_read(DISK_REQUEST *);
+void start_disk_request(void);
+void start_disk_command(void);
+void complete_disk_request(uint8_t);
+void handler_disk_entry(void);
+void disk_interrupt_handler(void);
+
+/*** cache.c ***/
+void init_cache(void);
+void reset_cache_stats(void);
+void flush_cache(void);
+uint32_t cache_blocks_used(void);
+CACHE_BLOCK *find_cache_block(uint32_t);
+void touch_cache_block(CACHE_BLOCK *);
+CACHE_BLOCK *get_cache_block(uint32_t);
+uint8_t *cached_sector(uint32_t);
+void cache_sector(uint32_t, uint8_t *);
+uint8_t read_disk_cached(uint32_t, uint8_t, uint8_t *);
+bool cache_read_frames(uint32_t, uint32_t, uint32_t *);
+void cache_write_frames(uint32_t, uint32_t, uint32_t *);
 
 /*** pmemman.c ***/
 void init_physical_memory_manager(void);
 uint32_t find_frames(uint32_t, uint32_t, uint32_t);
 void *alloc_frames(uint32_t, bool);
 void dealloc_frames(void *,uint32_t);
+uint32_t find_longest_run(uint32_t, uint32_t, uint32_t, uint32_t *);
+void *alloc_frame_run(uint32_t, uint32_t *);
+bool alloc_frames_scattered(uint32_t, uint32_t *);
+void dealloc_frames_scattered(uint32_t *, uint32_t);
+uint32_t count_free_frames(uint32_t, uint32_t);
+uint32_t count_free_memory(void);
 void modify_bitmap(uint32_t, uint32_t, bool);
+void claim_frames(uint32_t, uint32_t, uint8_t);
+void ref_frames(void *, uint32_t);
+uint32_t get_frame_refs(void *);
+uint8_t get_frame_type(void *);
+void set_frame_type(void *, uint32_t, uint8_t);
+uint32_t count_frames(uint8_t);
 uint32_t bytes_to_frames(uint32_t);
 
 /*** lmemman.c ***/
-bool init_logical_memory(PCB*, uint32_t);
+bool init_logical_memory(PCB*, IMAGE *);
 void init_kernel_pages(void);
 void load_CR3(uint32_t);
+void invalidate_page(uint32_t);
+bool resolve_page_fault(PCB *, uint32_t, uint32_t, uint32_t);
+bool grow_stack(PCB *, uint32_t);
+bool copy_on_write(PTE *, uint32_t);
 void *alloc_kernel_pages(uint32_t);
 void *alloc_user_pages(uint32_t, uint32_t, PDE *, uint32_t); 
 void dealloc_page(void *, PDE *);
 void dealloc_all_pages(PDE *);
 void zero_out_pages(void *, uint32_t);
+void *map_frame(uint32_t);
+PTE *get_pte(PCB *, uint32_t);
+bool user_range_ok(uint32_t, uint32_t);
 
 /*** mutex.c ***/
+MUTEX *get_mutex(mutex_t);
 mutex_t mutex_create(PCB *);
 void mutex_destroy(mutex_t, PCB *);
 bool mutex_lock(mutex_t, PCB *);
 bool mutex_unlock(mutex_t, PCB *);
 void init_mutexes(void);
 void free_mutex_locks(PCB *);
+bool mutex_holder(mutex_t, PCB *);
+bool mutex_trylock(mutex_t, PCB *);
+QUEUE *mutex_queue(mutex_t);
+PCB *mutex_owner(mutex_t);
+void hold_mutex(MUTEX *, PCB *);
+void drop_mutex(MUTEX *);
+PCB *release_mutex(MUTEX *);
+void inherit_priority(PCB *, uint8_t);
+void update_priority(PCB *);
+WAIT_NODE *highest_priority_waiter(QUEUE *);
+
+/*** barrier.c ***/
+void init_barriers(void);
+BARRIER *get_barrier(barrier_t);
+barrier_t barrier_create(uint32_t, PCB *);
+void barrier_destroy(barrier_t, PCB *);
+bool barrier_wait(barrier_t, PCB *);
+void free_barriers(PCB *);
+
+/*** condition.c ***/
+void init_conditions(void);
+COND *get_cond(cond_t);
+cond_t cond_create(PCB *);
+void cond_destroy(cond_t, PCB *);
+bool cond_wait(cond_t, mutex_t, PCB *);
+void cond_signal(cond_t);
+void cond_broadcast(cond_t);
+void free_conditions(PCB *);
+
+/*** rwlock.c ***/
+void init_rwlocks(void);
+RWLOCK *get_rwlock(rwlock_t);
+rwlock_t rwlock_create(PCB *);
+void rwlock_destroy(rwlock_t, PCB *);
+bool rwlock_lock(rwlock_t, bool, PCB *);
+bool rwlock_unlock(rwlock_t, PCB *);
+void grant_rwlock(RWLOCK *);
+void hold_write(RWLOCK *, PCB *);
+void drop_write(RWLOCK *);
+READ_HOLD *find_read_hold(PCB *, rwlock_t);
+void free_rwlocks(PCB *);
+
+/*** pipe.c ***/
+void init_pipes(void);
+pipe_t pipe_create(void);
+bool pipe_open(pipe_t, uint32_t, PCB *);
+void pipe_close(pipe_t, uint32_t);
+bool pipe_read(PCB *, uint8_t *, uint32_t, uint32_t *);
+bool pipe_write(PCB *, uint8_t *, uint32_t, uint32_t *);
+uint32_t give_page(PCB *, uint32_t);
+bool receive_page(PCB *, uint32_t, uint32_t);
+void wake_pipe_queue(QUEUE *);
+bool pipe_readable(PCB *);
+QUEUE *pipe_read_queue(PCB *);
+void free_pipes(PCB *);
+
+/*** futex.c ***/
+void init_futexes(void);
+QUEUE *futex_queue(uint32_t);
+bool futex_wait(uint32_t *, uint32_t, PCB *);
+uint32_t futex_wake(uint32_t *, uint32_t, PCB *);
+uint32_t futex_key(uint32_t *, PCB *);
+void free_futexes(PCB *);
+
+/*** handle.c ***/
+void init_handle_table(HANDLE_TABLE *, uint32_t);
+OBJECT_HEADER *object_at(HANDLE_TABLE *, uint32_t);
+bool grow_handle_table(HANDLE_TABLE *);
+OBJECT_HEADER *alloc_object(HANDLE_TABLE *, PCB *, OBJECT_LIST *);
+void free_object(HANDLE_TABLE *, OBJECT_HEADER *, OBJECT_LIST *);
+OBJECT_HEADER *get_object(HANDLE_TABLE *, uint32_t);
+uint32_t object_handle(OBJECT_HEADER *);
+
+/*** lockstat.c ***/
+void reset_lock_stats(LOCK_STATS *);
+void lock_acquired(LOCK_STATS *, WAIT_NODE *);
+
+/*** wait.c ***/
+bool wait_objects(PCB *, WAIT_OBJECT *, uint32_t, uint32_t, uint32_t *);
+void wait_any_fired(WAIT_NODE *);
+void wait_any_cancel(WAIT_NODE *);
+void wait_any_timeout(PCB *);
+void remove_wait_any(PCB *, WAIT_NODE *);
+void free_wait_any(PCB *);
+
+/*** ipc.c ***/
+bool send_message(PCB *, uint32_t, bool);
+bool receive_message(PCB *, uint32_t);
+bool reply_message(PCB *, uint32_t);
+void deliver_message(PCB *, PCB *);
+void free_ipc(PCB *);
 
 /*** queue.c ***/
 void init_queue(QUEUE *);
-uint32_t enqueue(QUEUE *, PCB *);
+void enqueue(QUEUE *, WAIT_NODE *);
 PCB *dequeue(QUEUE *);
-void free_queue(QUEUE *);
 void print_queue(QUEUE *);
-void remove_queue_item(QUEUE *, uint32_t);
+void remove_queue_item(QUEUE *, WAIT_NODE *);
 
 /*** runprogram.c ***/
-void run(uint32_t, uint32_t);
-bool load_disk_to_memory(uint32_t, uint32_t, uint8_t *);
+bool run(uint32_t, uint32_t, pipe_t, pipe_t);
 
 /*** timer.c ***/
 void init_timer(void);
@@ -405,7 +912,16 @@ uint32_t get_epoch_length();
 void init_scheduler(void);
 PCB *add_to_processq(PCB *p);
 PCB *remove_from_processq(PCB *p);
+void reclaim_process(PCB *);
+void reclaim_processes(void);
+void reclaim_all_processes(void);
 void schedule_something(void);
+void set_priority(PCB *, uint8_t);
+void register_process(PCB *);
+void unregister_process(PCB *);
+PCB *find_process(uint32_t);
+void switch_directly(PCB *);
+void wakeup_handoff(PCB *, PCB *);
 __attribute__((fastcall)) void switch_to_kernel_process(PCB *);
 __attribute__((fastcall)) void switch_to_user_process(PCB *);
 
@@ -413,14 +929,39 @@ __attribute__((fastcall)) void switch_to_user_process(PCB *);
 void init_semaphores(void);
 sem_t semaphore_create(uint8_t, PCB *);
 void semaphore_destroy(sem_t, PCB *);
+SEMAPHORE *get_semaphore(sem_t);
 bool semaphore_down(sem_t, PCB *);
 void semaphore_up(sem_t, PCB *);
+bool semaphore_down_n(sem_t, uint32_t, PCB *);
+void semaphore_up_n(sem_t, uint32_t, PCB *);
+bool semaphore_trydown(sem_t);
+QUEUE *semaphore_queue(sem_t);
+void semaphore_timeout(PCB *);
 void free_semaphores(PCB *);
 
+/*** image.c ***/
+void init_images(void);
+IMAGE *get_image(uint32_t, uint32_t);
+uint8_t load_image(PCB *);
+void image_loaded(DISK_REQUEST *);
+void release_image(IMAGE *);
+
 /*** shared_memory.c ***/
 void init_shared_memory(void);
-void *shm_create(uint8_t, uint32_t, PCB *);
-void *shm_attach(uint8_t, uint32_t, PCB *);
-void shm_detach(PCB *);
+void *shm_create(uint8_t, uint32_t, uint32_t, PCB *);
+void *shm_attach(uint8_t, uint32_t, uint32_t, PCB *);
+void *shm_open(char *, uint32_t, uint32_t, PCB *);
+bool shm_unlink(char *);
+bool shm_detach(uint32_t, PCB *);
+SHMEM *new_shm(uint32_t, uint32_t *, PCB *);
+void *map_shm(SHMEM *, uint32_t, uint32_t, PCB *);
+void release_shm(SHMEM *);
+SHMEM *find_shm(char *);
+uint32_t shm_name_hash(char *);
+uint32_t shm_pages(SHMEM *);
+uint32_t find_shm_space(PCB *, uint32_t, uint32_t);
+void add_shm_attachment(PCB *, uint32_t, uint32_t);
+PTE *alloc_shm_pte(PCB *, uint32_t);
+void unmap_shm(PCB *, SHMEM *, uint32_t, uint32_t);
 void free_shared_memory(PCB *);
 
@@ -28,6 +28,39 @@ void execute_0x94(void) {
 		case SYSCALL_SHM_CREATE: _0x94_shm_create(); break;
 		case SYSCALL_SHM_ATTACH: _0x94_shm_attach(); break;
 		case SYSCALL_SHM_DETACH: _0x94_shm_detach(); break;
+		case SYSCALL_FUTEX_WAIT: _0x94_futex_wait(); break;
+		case SYSCALL_FUTEX_WAKE: _0x94_futex_wake(); break;
+		case SYSCALL_SET_PRIORITY: _0x94_set_priority(); break;
+		case SYSCALL_COND_CREATE: _0x94_cond_create(); break;
+		case SYSCALL_COND_DESTROY: _0x94_cond_destroy(); break;
+		case SYSCALL_COND_WAIT: _0x94_cond_wait(); break;
+		case SYSCALL_COND_SIGNAL: _0x94_cond_signal(); break;
+		case SYSCALL_COND_BROADCAST: _0x94_cond_broadcast(); break;
+		case SYSCALL_RWLOCK_CREATE: _0x94_rwlock_create(); break;
+		case SYSCALL_RWLOCK_DESTROY: _0x94_rwlock_destroy(); break;
+		case SYSCALL_RWLOCK_LOCK: _0x94_rwlock_lock(); break;
+		case SYSCALL_RWLOCK_UNLOCK: _0x94_rwlock_unlock(); break;
+		case SYSCALL_SEM_DOWN_TIMEOUT: _0x94_semaphore_down_timeout(); break;
+		case SYSCALL_SEM_UP_N: _0x94_semaphore_up_n(); break;
+		case SYSCALL_SEM_DOWN_N: _0x94_semaphore_down_n(); break;
+		case SYSCALL_PIPE_CREATE: _0x94_pipe_create(); break;
+		case SYSCALL_PIPE_ATTACH: _0x94_pipe_attach(); break;
+		case SYSCALL_PIPE_DETACH: _0x94_pipe_detach(); break;
+		case SYSCALL_PIPE_READ: _0x94_pipe_read(); break;
+		case SYSCALL_PIPE_WRITE: _0x94_pipe_write(); break;
+		case SYSCALL_WAIT_ANY: _0x94_wait_any(); break;
+		case SYSCALL_SHM_OPEN: _0x94_shm_open(); break;
+		case SYSCALL_SHM_UNLINK: _0x94_shm_unlink(); break;
+		case SYSCALL_GETPID: _0x94_getpid(); break;
+		case SYSCALL_IPC_SEND: _0x94_ipc_send(); break;
+		case SYSCALL_IPC_RECEIVE: _0x94_ipc_receive(); break;
+		case SYSCALL_IPC_CALL: _0x94_ipc_call(); break;
+		case SYSCALL_IPC_REPLY: _0x94_ipc_reply(); break;
+		case SYSCALL_IPC_REPLY_WAIT: _0x94_ipc_reply_wait(); break;
+		case SYSCALL_BARRIER_CREATE: _0x94_barrier_create(); break;
+		case SYSCALL_BARRIER_DESTROY: _0x94_barrier_destroy(); break;
+		case SYSCALL_BARRIER_WAIT: _0x94_barrier_wait(); break;
+		case SYSCALL_UPTIME: _0x94_uptime(); break;
 	}
 }
 
@@ -72,7 +105,7 @@ void _0x94_mutex_create(void) {
 
 /** Destroy a mutex ***/
 void _0x94_mutex_destroy(void) {
-	uint8_t key = (uint8_t)current_process->cpu.ebx;
+	mutex_t key = (mutex_t)current_process->cpu.ebx;
 	mutex_destroy(key,current_process);
 	
 	current_process->state = READY;
@@ -80,7 +113,7 @@ void _0x94_mutex_destroy(void) {
 
 /*** Obtain lock on a mutex ***/
 void _0x94_mutex_lock(void) {
-	uint8_t key = (uint8_t)current_process->cpu.ebx;
+	mutex_t key = (mutex_t)current_process->cpu.ebx;
 
 	if (mutex_lock(key,current_process)) // lock obtained
 		current_process->state = READY;
@@ -88,7 +121,7 @@ void _0x94_mutex_lock(void) {
 
 /*** Unlock a mutex ***/
 void _0x94_mutex_unlock(void) {
-	uint8_t key = (uint8_t)current_process->cpu.ebx;
+	mutex_t key = (mutex_t)current_process->cpu.ebx;
 	current_process->cpu.edx = mutex_unlock(key,current_process); // return value
 
 	current_process->state = READY;
@@ -104,7 +137,7 @@ void _0x94_semaphore_create(void) {
 
 /** Destroy a semaphore ***/
 void _0x94_semaphore_destroy(void) {
-	uint8_t key = (uint8_t)current_process->cpu.ebx;
+	sem_t key = (sem_t)current_process->cpu.ebx;
 	semaphore_destroy(key,current_process);
 	
 	current_process->state = READY;
@@ -112,7 +145,7 @@ void _0x94_semaphore_destroy(void) {
 
 /*** UP operation on a semaphore ***/
 void _0x94_semaphore_up(void) {
-	uint8_t key = (uint8_t)current_process->cpu.ebx;
+	sem_t key = (sem_t)current_process->cpu.ebx;
 	semaphore_up(key,current_process);
 	
 	current_process->state = READY;
@@ -120,18 +153,235 @@ void _0x94_semaphore_up(void) {
 
 /*** DOWN operation on a semaphore ***/
 void _0x94_semaphore_down(void) {
-	uint8_t key = (uint8_t)current_process->cpu.ebx;
+	sem_t key = (sem_t)current_process->cpu.ebx;
+
+	if (semaphore_down(key,current_process)) // obtained
+		current_process->state = READY;
+}
+
+/*** DOWN operation on a semaphore with a timeout ***/
+// Process waits for at most ECX milliseconds; the wait is ended by
+// the scheduler like a sleep (see semaphore_timeout)
+void _0x94_semaphore_down_timeout(void) {
+	sem_t key = (sem_t)current_process->cpu.ebx;
+	uint32_t tts = current_process->cpu.ecx;
 
+	current_process->cpu.edx = TRUE; // return value (FALSE if timed out)
 	if (semaphore_down(key,current_process)) // obtained
 		current_process->state = READY;
+	else
+		current_process->sleep_end = get_epochs() + tts/get_epoch_length() + 1; // never 0
+}
+
+/*** UP operation by n on a semaphore ***/
+void _0x94_semaphore_up_n(void) {
+	sem_t key = (sem_t)current_process->cpu.ebx;
+	uint32_t n = current_process->cpu.ecx;
+	semaphore_up_n(key,n,current_process);
+
+	current_process->state = READY;
+}
+
+/*** DOWN operation by n on a semaphore ***/
+void _0x94_semaphore_down_n(void) {
+	sem_t key = (sem_t)current_process->cpu.ebx;
+	uint32_t n = current_process->cpu.ecx;
+
+	if (semaphore_down_n(key,n,current_process)) // obtained
+		current_process->state = READY;
+}
+
+/*** Create a barrier ***/
+void _0x94_barrier_create(void) {
+	uint32_t count = current_process->cpu.ebx;
+	current_process->cpu.edx = barrier_create(count, current_process); // return value
+
+	current_process->state = READY;
+}
+
+/*** Destroy a barrier ***/
+void _0x94_barrier_destroy(void) {
+	barrier_t key = (barrier_t)current_process->cpu.ebx;
+	barrier_destroy(key,current_process);
+
+	current_process->state = READY;
+}
+
+/*** Wait at a barrier ***/
+// Return value is set by barrier.c, also when the process has to wait
+void _0x94_barrier_wait(void) {
+	barrier_t key = (barrier_t)current_process->cpu.ebx;
+
+	if (barrier_wait(key,current_process)) // last to arrive
+		current_process->state = READY;
+}
+
+/*** Create a condition variable ***/
+void _0x94_cond_create(void) {
+	current_process->cpu.edx = cond_create(current_process); // return value
+	current_process->state = READY;
+}
+
+/*** Destroy a condition variable ***/
+void _0x94_cond_destroy(void) {
+	cond_t key = (cond_t)current_process->cpu.ebx;
+	cond_destroy(key,current_process);
+
+	current_process->state = READY;
+}
+
+/*** Wait on a condition variable ***/
+// Mutex is released while waiting and obtained again before returning
+void _0x94_cond_wait(void) {
+	cond_t key = (cond_t)current_process->cpu.ebx;
+	mutex_t m = (mutex_t)current_process->cpu.ecx;
+
+	current_process->cpu.edx = TRUE; // return value (when woken up)
+	if (!cond_wait(key,m,current_process)) { // mutex not held
+		current_process->cpu.edx = FALSE;
+		current_process->state = READY;
+	}
+}
+
+/*** Signal a condition variable ***/
+void _0x94_cond_signal(void) {
+	cond_t key = (cond_t)current_process->cpu.ebx;
+	cond_signal(key);
+
+	current_process->state = READY;
+}
+
+/*** Broadcast a condition variable ***/
+void _0x94_cond_broadcast(void) {
+	cond_t key = (cond_t)current_process->cpu.ebx;
+	cond_broadcast(key);
+
+	current_process->state = READY;
+}
+
+/*** Create a reader-writer lock ***/
+void _0x94_rwlock_create(void) {
+	current_process->cpu.edx = rwlock_create(current_process); // return value
+	current_process->state = READY;
+}
+
+/*** Destroy a reader-writer lock ***/
+void _0x94_rwlock_destroy(void) {
+	rwlock_t key = (rwlock_t)current_process->cpu.ebx;
+	rwlock_destroy(key,current_process);
+
+	current_process->state = READY;
+}
+
+/*** Obtain a reader-writer lock ***/
+// ECX is TRUE to lock for writing, FALSE for reading; the return
+// value is set by rwlock_lock
+void _0x94_rwlock_lock(void) {
+	rwlock_t key = (rwlock_t)current_process->cpu.ebx;
+	bool write = (bool)current_process->cpu.ecx;
+
+	if (rwlock_lock(key,write,current_process)) // lock obtained (or no such lock)
+		current_process->state = READY;
+}
+
+/*** Release a reader-writer lock ***/
+void _0x94_rwlock_unlock(void) {
+	rwlock_t key = (rwlock_t)current_process->cpu.ebx;
+	current_process->cpu.edx = rwlock_unlock(key,current_process); // return value
+
+	current_process->state = READY;
+}
+
+/*** Create a pipe ***/
+void _0x94_pipe_create(void) {
+	current_process->cpu.edx = pipe_create(); // return value
+	current_process->state = READY;
+}
+
+/*** Open one end of a pipe ***/
+void _0x94_pipe_attach(void) {
+	uint8_t key = (uint8_t)current_process->cpu.ebx;
+	uint32_t mode = current_process->cpu.ecx;
+
+	if (mode != PIPE_READ_END && mode != PIPE_WRITE_END)
+		current_process->cpu.edx = FALSE;
+	else
+		current_process->cpu.edx = pipe_open(key, mode, current_process); // return value
+
+	current_process->state = READY;
+}
+
+/*** Close one end of a pipe ***/
+void _0x94_pipe_detach(void) {
+	uint32_t mode = current_process->cpu.ebx;
+
+	if (mode == PIPE_READ_END && current_process->pipe.in != 0) {
+		pipe_close(current_process->pipe.in, PIPE_READ_END);
+		current_process->pipe.in = 0;
+	}
+	else if (mode == PIPE_WRITE_END && current_process->pipe.out != 0) {
+		pipe_close(current_process->pipe.out, PIPE_WRITE_END);
+		current_process->pipe.out = 0;
+	}
+
+	current_process->state = READY;
+}
+
+/*** Read from the input pipe ***/
+// If nothing can be read yet, the process waits and issues the
+// system call again when woken up (INT 0x94 is two bytes long)
+void _0x94_pipe_read(void) {
+	uint8_t *buf = (uint8_t *)current_process->cpu.ebx;
+	uint32_t n = current_process->cpu.ecx;
+	uint32_t n_read = 0;
+
+	if (!user_range_ok((uint32_t)buf, n) || 
+	    pipe_read(current_process, buf, n, &n_read)) {
+		current_process->cpu.edx = n_read; // return value
+		current_process->state = READY;
+	}
+	else current_process->cpu.eip -= 2; 
+}
+
+/*** Write to the output pipe ***/
+// If nothing can be written yet, the process waits and issues the
+// system call again when woken up
+void _0x94_pipe_write(void) {
+	uint8_t *buf = (uint8_t *)current_process->cpu.ebx;
+	uint32_t n = current_process->cpu.ecx;
+	uint32_t n_written = 0;
+
+	if (!user_range_ok((uint32_t)buf, n) || 
+	    pipe_write(current_process, buf, n, &n_written)) {
+		current_process->cpu.edx = n_written; // return value
+		current_process->state = READY;
+	}
+	else current_process->cpu.eip -= 2;
+}
+
+/*** Wait on any of a set of objects ***/
+// Return value is the index of the object that fired, WAIT_TIMEOUT
+// or WAIT_ERROR; it is set by wait.c if the process has to wait
+void _0x94_wait_any(void) {
+	WAIT_OBJECT *objs = (WAIT_OBJECT *)current_process->cpu.ebx;
+	uint32_t n = current_process->cpu.ecx;
+	uint32_t tts = current_process->cpu.edx;
+	uint32_t index = WAIT_ERROR;
+
+	if (n > WAIT_MAXOBJECTS || !user_range_ok((uint32_t)objs, n*sizeof(WAIT_OBJECT)) ||
+	    wait_objects(current_process, objs, n, tts, &index)) {
+		current_process->cpu.edx = index; // return value
+		current_process->state = READY;
+	}
 }
 
 /*** Create shared memory area ***/
 void _0x94_shm_create(void) {
 	uint8_t key = (uint8_t)current_process->cpu.ebx;
 	uint32_t size = (uint32_t)current_process->cpu.ecx;
+	uint32_t addr = (uint32_t)current_process->cpu.edx; // 0: any address
 
-	current_process->cpu.edx = (uint32_t) shm_create(key, size, current_process); // return value
+	current_process->cpu.edx = (uint32_t) shm_create(key, size, addr, current_process); // return value
 
 	current_process->state = READY;
 }
@@ -140,19 +390,132 @@ void _0x94_shm_create(void) {
 void _0x94_shm_attach(void) {
 	uint8_t key = (uint8_t)current_process->cpu.ebx;
 	uint32_t mode = (uint32_t)current_process->cpu.ecx;
+	uint32_t addr = (uint32_t)current_process->cpu.edx; // 0: any address
 
-	current_process->cpu.edx = (uint32_t) shm_attach(key, mode, current_process); // return value
+	current_process->cpu.edx = (uint32_t) shm_attach(key, mode, addr, current_process); // return value
 
 	current_process->state = READY;
 }
 
 /*** Detach from a shared memory area ***/
 void _0x94_shm_detach(void) {
-	shm_detach(current_process);
+	uint32_t addr = (uint32_t)current_process->cpu.ebx;
+
+	current_process->cpu.edx = shm_detach(addr, current_process); // return value
 	
 	current_process->state = READY;
 }
 
+/*** Create or open a named shared memory area ***/
+void _0x94_shm_open(void) {
+	char name[SHM_NAMELEN];
+	uint32_t size = (uint32_t)current_process->cpu.ecx;
+	uint32_t mode = (uint32_t)current_process->cpu.edx;
+
+	if (copy_shm_name(name, (char *)current_process->cpu.ebx))
+		current_process->cpu.edx = (uint32_t) shm_open(name, size, mode, current_process); // return value
+	else
+		current_process->cpu.edx = NULL;
+
+	current_process->state = READY;
+}
+
+/*** Remove the name of a shared memory area ***/
+void _0x94_shm_unlink(void) {
+	char name[SHM_NAMELEN];
+
+	if (copy_shm_name(name, (char *)current_process->cpu.ebx))
+		current_process->cpu.edx = shm_unlink(name); // return value
+	else
+		current_process->cpu.edx = FALSE;
 
+	current_process->state = READY;
+}
+
+/*** Return milliseconds since start ***/
+void _0x94_uptime(void) {
+	current_process->cpu.edx = get_uptime(); // return value
+
+	current_process->state = READY;
+}
 
+/*** Return the pid of the process ***/
+void _0x94_getpid(void) {
+	current_process->cpu.edx = current_process->pid; // return value
 
+	current_process->state = READY;
+}
+
+/*** Message passing ***/
+// Destination (or source) pid in EBX, message in ECX, EDX and ESI;
+// return value (0, pid of the sender or IPC_ERROR) in EAX is set by
+// ipc.c, also when the process has to wait
+void _0x94_ipc_send(void) {
+	if (send_message(current_process, current_process->cpu.ebx, FALSE))
+		current_process->state = READY;
+}
+
+void _0x94_ipc_receive(void) {
+	if (receive_message(current_process, current_process->cpu.ebx))
+		current_process->state = READY;
+}
+
+void _0x94_ipc_call(void) {
+	if (send_message(current_process, current_process->cpu.ebx, TRUE))
+		current_process->state = READY;
+}
+
+void _0x94_ipc_reply(void) {
+	current_process->cpu.eax = reply_message(current_process, current_process->cpu.ebx) ? 0 : IPC_ERROR; // return value
+
+	current_process->state = READY;
+}
+
+// Reply (if the destination is waiting for it) and wait for the next
+// message from anybody
+void _0x94_ipc_reply_wait(void) {
+	reply_message(current_process, current_process->cpu.ebx);
+	if (receive_message(current_process, IPC_ANY))
+		current_process->state = READY;
+}
+
+/*** Copy a shared memory name from user memory ***/
+// Returns FALSE if the name is empty or too long
+bool copy_shm_name(char *name, char *user_name) {
+	uint32_t i;
+
+	for (i=0; i<SHM_NAMELEN; i++) {
+		if (!user_range_ok((uint32_t)&user_name[i], 1)) return FALSE;
+		name[i] = user_name[i];
+		if (name[i] == 0) return (i > 0);
+	}
+	return FALSE;
+}
+
+/*** Wait on a futex ***/
+// Process keeps waiting only if the word still has the expected value
+void _0x94_futex_wait(void) {
+	uint32_t *addr = (uint32_t *)current_process->cpu.ebx;
+	uint32_t value = (uint32_t)current_process->cpu.ecx;
+
+	if (!futex_wait(addr, value, current_process)) // value changed; do not wait
+		current_process->state = READY;
+}
+
+/*** Wake up processes waiting on a futex ***/
+void _0x94_futex_wake(void) {
+	uint32_t *addr = (uint32_t *)current_process->cpu.ebx;
+	uint32_t n = (uint32_t)current_process->cpu.ecx;
+
+	current_process->cpu.edx = futex_wake(addr, n, current_process); // return value
+
+	current_process->state = READY;
+}
+
+/*** Change priority of the calling process ***/
+void _0x94_set_priority(void) {
+	uint8_t priority = (uint8_t)current_process->cpu.ebx;
+	set_priority(current_process, priority);
+
+	current_process->state = READY;
+}
@@ -203,6 +203,7 @@ char sys_getc(void) {
 
 	while (key==KEY_UNKNOWN
 			|| key==KEY_LSHIFT || key==KEY_RSHIFT) { // control keys
+		reclaim_processes(); // nothing else to do while waiting; in scheduler.c
 		key = get_key();
 	}
 
@@ -88,6 +88,24 @@ void sleep(uint32_t tts) { // SYSTEM CALL
 	asm volatile ("int $0x94\n");
 }
 
+/*** Change priority of calling process (0 lowest, 7 highest) ***/
+void setpriority(uint8_t priority) { // SYSTEM CALL
+	asm volatile ("movl %0, %%ebx\n": :"m" (priority));
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_SET_PRIORITY)); // set priority function
+	asm volatile ("int $0x94\n");
+}
+
+/*** Milliseconds since start (10ms resolution) ***/
+uint32_t uptime(void) { // SYSTEM CALL
+	uint32_t ret;
+
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_UPTIME)); // uptime function
+	asm volatile ("int $0x94\n");
+
+	asm volatile ("movl %%edx, %0\n": "=m" (ret));
+	return ret;
+}
+
 /*** Mutex functions ***/
 mutex_t mcreate() { // SYSTEM CALL
 	uint32_t ret;
@@ -152,12 +170,262 @@ void sup(sem_t key) { // SYSTEM CALL
 	asm volatile ("int $0x94\n");
 }
 
+// Returns FALSE if the semaphore could not be obtained within
+// tts milliseconds
+bool sdown_timeout(sem_t key, uint32_t tts) { // SYSTEM CALL
+	bool ret;
+
+	asm volatile ("movl %0, %%ebx\n": :"m" (key));
+	asm volatile ("movl %0, %%ecx\n": :"m" (tts));
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_SEM_DOWN_TIMEOUT)); // semaphore timed down function
+	asm volatile ("int $0x94\n");
+
+	asm volatile ("movl %%edx, %0\n": "=m" (ret));
+	return ret;
+}
+
+// Increase the semaphore by n (wakes up to n waiters)
+void sup_n(sem_t key, uint32_t n) { // SYSTEM CALL
+	asm volatile ("movl %0, %%ebx\n": :"m" (key));
+	asm volatile ("movl %0, %%ecx\n": :"m" (n));
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_SEM_UP_N)); // semaphore up by n function
+	asm volatile ("int $0x94\n");
+}
+
+// Decrease the semaphore by n at once
+void sdown_n(sem_t key, uint32_t n) { // SYSTEM CALL
+	asm volatile ("movl %0, %%ebx\n": :"m" (key));
+	asm volatile ("movl %0, %%ecx\n": :"m" (n));
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_SEM_DOWN_N)); // semaphore down by n function
+	asm volatile ("int $0x94\n");
+}
+
+/*** Barrier functions ***/
+// A barrier for <count> processes; bwait returns when <count> processes
+// are waiting at the barrier, with BARRIER_SERIAL in one of them
+barrier_t bcreate(uint32_t count) { // SYSTEM CALL
+	uint32_t ret;
+
+	asm volatile ("movl %0, %%ebx\n": :"m" (count));
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_BARRIER_CREATE)); // barrier create function
+	asm volatile ("int $0x94\n");
+
+	asm volatile ("movl %%edx, %0\n": "=m" (ret));
+	return (barrier_t)ret;
+}
+
+void bdestroy(barrier_t key) { // SYSTEM CALL
+	asm volatile ("movl %0, %%ebx\n": :"m" (key));
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_BARRIER_DESTROY)); // barrier destroy function
+	asm volatile ("int $0x94\n");
+}
+
+uint32_t bwait(barrier_t key) { // SYSTEM CALL
+	uint32_t ret;
+
+	asm volatile ("movl %0, %%ebx\n": :"m" (key));
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_BARRIER_WAIT)); // barrier wait function
+	asm volatile ("int $0x94\n");
+
+	asm volatile ("movl %%edx, %0\n": "=m" (ret));
+	return ret;
+}
+
+/*** Condition variable functions ***/
+cond_t ccreate(void) { // SYSTEM CALL
+	uint32_t ret;
+
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_COND_CREATE)); // condition variable create function
+	asm volatile ("int $0x94\n");
+
+	asm volatile ("movl %%edx, %0\n": "=m" (ret));
+	return (cond_t)ret; // 0 means unsuccessful
+}
+
+void cdestroy(cond_t key) { // SYSTEM CALL
+	asm volatile ("movl %0, %%ebx\n": :"m" (key));
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_COND_DESTROY)); // condition variable destroy function
+	asm volatile ("int $0x94\n");
+}
+
+// Mutex m must be locked by the caller; it is released while waiting
+// and locked again before returning
+bool cwait(cond_t key, mutex_t m) { // SYSTEM CALL
+	bool ret;
+
+	asm volatile ("movl %0, %%ebx\n": :"m" (key));
+	asm volatile ("movl %0, %%ecx\n": :"m" (m));
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_COND_WAIT)); // condition variable wait function
+	asm volatile ("int $0x94\n");
+
+	asm volatile ("movl %%edx, %0\n": "=m" (ret));
+	return ret; // FALSE means mutex not held
+}
+
+void csignal(cond_t key) { // SYSTEM CALL
+	asm volatile ("movl %0, %%ebx\n": :"m" (key));
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_COND_SIGNAL)); // condition variable signal function
+	asm volatile ("int $0x94\n");
+}
+
+void cbroadcast(cond_t key) { // SYSTEM CALL
+	asm volatile ("movl %0, %%ebx\n": :"m" (key));
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_COND_BROADCAST)); // condition variable broadcast function
+	asm volatile ("int $0x94\n");
+}
+
+/*** Reader-writer lock functions ***/
+rwlock_t rwcreate(void) { // SYSTEM CALL
+	uint32_t ret;
+
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_RWLOCK_CREATE)); // reader-writer lock create function
+	asm volatile ("int $0x94\n");
+
+	asm volatile ("movl %%edx, %0\n": "=m" (ret));
+	return (rwlock_t)ret; // 0 means unsuccessful
+}
+
+void rwdestroy(rwlock_t key) { // SYSTEM CALL
+	asm volatile ("movl %0, %%ebx\n": :"m" (key));
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_RWLOCK_DESTROY)); // reader-writer lock destroy function
+	asm volatile ("int $0x94\n");
+}
+
+bool rdlock(rwlock_t key) { // SYSTEM CALL
+	bool ret;
+
+	asm volatile ("movl %0, %%ebx\n": :"m" (key));
+	asm volatile ("movl %0, %%ecx\n": :"i" (FALSE)); // for reading
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_RWLOCK_LOCK)); // reader-writer lock function
+	asm volatile ("int $0x94\n");
+
+	asm volatile ("movl %%edx, %0\n": "=m" (ret));
+	return ret; // FALSE means lock not obtained
+}
+
+bool wrlock(rwlock_t key) { // SYSTEM CALL
+	bool ret;
+
+	asm volatile ("movl %0, %%ebx\n": :"m" (key));
+	asm volatile ("movl %0, %%ecx\n": :"i" (TRUE)); // for writing
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_RWLOCK_LOCK)); // reader-writer lock function
+	asm volatile ("int $0x94\n");
+
+	asm volatile ("movl %%edx, %0\n": "=m" (ret));
+	return ret; // FALSE means lock not obtained
+}
+
+bool rwunlock(rwlock_t key) { // SYSTEM CALL
+	bool ret;
+
+	asm volatile ("movl %0, %%ebx\n": :"m" (key));
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_RWLOCK_UNLOCK)); // reader-writer unlock function
+	asm volatile ("int $0x94\n");
+
+	asm volatile ("movl %%edx, %0\n": "=m" (ret));
+	return ret; // FALSE means unsuccessful
+}
+
+/*** Pipe functions ***/
+pipe_t pcreate(void) { // SYSTEM CALL
+	uint32_t ret;
+
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_PIPE_CREATE)); // pipe create function
+	asm volatile ("int $0x94\n");
+
+	asm volatile ("movl %%edx, %0\n": "=m" (ret));
+	return (pipe_t)ret; // 0 means unsuccessful
+}
+
+// mode is PIPE_READ_END or PIPE_WRITE_END
+bool pattach(pipe_t key, uint32_t mode) { // SYSTEM CALL
+	bool ret;
+
+	asm volatile ("movl %0, %%ebx\n": :"m" (key));
+	asm volatile ("movl %0, %%ecx\n": :"m" (mode));
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_PIPE_ATTACH)); // pipe attach function
+	asm volatile ("int $0x94\n");
+
+	asm volatile ("movl %%edx, %0\n": "=m" (ret));
+	return ret; // FALSE means unsuccessful
+}
+
+void pdetach(uint32_t mode) { // SYSTEM CALL
+	asm volatile ("movl %0, %%ebx\n": :"m" (mode));
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_PIPE_DETACH)); // pipe detach function
+	asm volatile ("int $0x94\n");
+}
+
+// Reads at most n bytes from the input pipe; returns the number of 
+// bytes read, 0 at end of input. Page aligned buffers of whole pages
+// receive the writer's pages without copying
+uint32_t pread(void *buf, uint32_t n) { // SYSTEM CALL
+	uint32_t ret;
+
+	asm volatile ("movl %0, %%ebx\n": :"m" (buf));
+	asm volatile ("movl %0, %%ecx\n": :"m" (n));
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_PIPE_READ)); // pipe read function
+	asm volatile ("int $0x94\n");
+
+	asm volatile ("movl %%edx, %0\n": "=m" (ret));
+	return ret;
+}
+
+// Writes n bytes to the output pipe; returns the number of bytes
+// written, less than n only if nobody reads the pipe any more
+uint32_t pwrite(void *buf, uint32_t n) { // SYSTEM CALL
+	uint32_t done = 0;
+	uint32_t ret;
+	uint8_t *next;
+	uint32_t left;
+
+	while (done < n) {
+		next = (uint8_t *)buf + done;
+		left = n - done;
+		asm volatile ("movl %0, %%ebx\n": :"m" (next));
+		asm volatile ("movl %0, %%ecx\n": :"m" (left));
+		asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_PIPE_WRITE)); // pipe write function
+		asm volatile ("int $0x94\n");
+
+		asm volatile ("movl %%edx, %0\n": "=m" (ret));
+		if (ret == 0) break; // broken pipe
+		done += ret;
+	}
+	return done;
+}
+
+/*** Wait on multiple objects ***/
+// Waits until one of the n objects can be obtained (semaphore DOWN
+// done, mutex locked) or read (input pipe), or tts milliseconds
+// have passed (tts 0: no timeout); returns the index of the object
+// in objs[], WAIT_TIMEOUT or WAIT_ERROR
+uint32_t wait_any(WAIT_OBJECT *objs, uint32_t n, uint32_t tts) { // SYSTEM CALL
+	uint32_t ret;
+
+	asm volatile ("movl %0, %%ebx\n": :"m" (objs));
+	asm volatile ("movl %0, %%ecx\n": :"m" (n));
+	asm volatile ("movl %0, %%edx\n": :"m" (tts));
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_WAIT_ANY)); // wait on multiple objects function
+	asm volatile ("int $0x94\n");
+
+	asm volatile ("movl %%edx, %0\n": "=m" (ret));
+	return ret;
+}
+
 /*** Shared memory functions ***/
-void  *smcreate(uint8_t key, uint32_t size) { // SYSTEM CALL
+// smcreate and smattach map the area at the lowest free address
+// (from 0x80000000 up); smcreate_at and smattach_at at <addr>, which
+// must be page aligned. A process can use several areas at a time
+void  *smcreate(uint8_t key, uint32_t size) {
+	return smcreate_at(key, size, NULL);
+}
+
+void  *smcreate_at(uint8_t key, uint32_t size, void *addr) { // SYSTEM CALL
 	uint32_t ret;
 
 	asm volatile ("movl %0, %%ebx\n": :"m" (key));
 	asm volatile ("movl %0, %%ecx\n": :"m" (size));
+	asm volatile ("movl %0, %%edx\n": :"m" (addr));
 	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_SHM_CREATE)); // shared memory create function
 	asm volatile ("int $0x94\n");
 
@@ -165,11 +433,16 @@ void  *smcreate(uint8_t key, uint32_t size) { // SYSTEM CALL
 	return (void *)ret; 
 }
 
-void  *smattach(uint8_t key, uint32_t mode) { // SYSTEM CALL
+void  *smattach(uint8_t key, uint32_t mode) {
+	return smattach_at(key, mode, NULL);
+}
+
+void  *smattach_at(uint8_t key, uint32_t mode, void *addr) { // SYSTEM CALL
 	uint32_t ret;
 
 	asm volatile ("movl %0, %%ebx\n": :"m" (key));
 	asm volatile ("movl %0, %%ecx\n": :"m" (mode));
+	asm volatile ("movl %0, %%edx\n": :"m" (addr));
 	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_SHM_ATTACH)); // shared memory attach function
 	asm volatile ("int $0x94\n");
 
@@ -177,9 +450,376 @@ void  *smattach(uint8_t key, uint32_t mode) { // SYSTEM CALL
 	return (void *)ret; 
 }
 
-void  smdetach() { // SYSTEM CALL
+// Detach the area mapped at <addr>; returns FALSE if there is none
+bool smdetach(void *addr) { // SYSTEM CALL
+	bool ret;
+
+	asm volatile ("movl %0, %%ebx\n": :"m" (addr));
 	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_SHM_DETACH)); // shared memory detach function
 	asm volatile ("int $0x94\n"); 
+
+	asm volatile ("movl %%edx, %0\n": "=m" (ret));
+	return ret;
+}
+
+// Named areas: smopen attaches to the area called <name> (at most 31
+// characters), creating it with <size> bytes if there is none (size
+// 0: do not create); the creator always gets it read-write. The area
+// stays, even when nobody is attached, until smunlink removes the name
+void *smopen(char *name, uint32_t size, uint32_t mode) { // SYSTEM CALL
+	uint32_t ret;
+
+	asm volatile ("movl %0, %%ebx\n": :"m" (name));
+	asm volatile ("movl %0, %%ecx\n": :"m" (size));
+	asm volatile ("movl %0, %%edx\n": :"m" (mode));
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_SHM_OPEN)); // shared memory open function
+	asm volatile ("int $0x94\n");
+
+	asm volatile ("movl %%edx, %0\n": "=m" (ret));
+	return (void *)ret; 
+}
+
+// Returns FALSE if there is no area with the name
+bool smunlink(char *name) { // SYSTEM CALL
+	bool ret;
+
+	asm volatile ("movl %0, %%ebx\n": :"m" (name));
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_SHM_UNLINK)); // shared memory unlink function
+	asm volatile ("int $0x94\n");
+
+	asm volatile ("movl %%edx, %0\n": "=m" (ret));
+	return ret;
 }
 
+/*** Process functions ***/
+uint32_t getpid(void) { // SYSTEM CALL
+	uint32_t ret;
+
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_GETPID)); // get pid function
+	asm volatile ("int $0x94\n");
+
+	asm volatile ("movl %%edx, %0\n": "=m" (ret));
+	return ret;
+}
+
+/*** Message passing functions ***/
+// A message is IPC_WORDS words; it is passed in registers, so a
+// send/receive pair does not copy memory. ipc_send waits until <dest>
+// receives; ipc_receive waits for a message from <from> (or IPC_ANY)
+// and returns the pid of the sender; ipc_call sends and waits for the
+// reply, which overwrites <msg>; ipc_reply_wait (servers) replies to
+// <dest> and waits for the next message. IPC_ERROR is returned if the
+// other process does not exist or ends
+static uint32_t ipc_syscall(uint32_t function, uint32_t pid, IPC_MSG *msg) {
+	uint32_t ret;
+	uint32_t w0 = msg->w[0], w1 = msg->w[1], w2 = msg->w[2];
+
+	asm volatile ("movl %0, %%ebx\n": :"m" (pid));
+	asm volatile ("movl %0, %%ecx\n": :"m" (w0));
+	asm volatile ("movl %0, %%edx\n": :"m" (w1));
+	asm volatile ("movl %0, %%esi\n": :"m" (w2));
+	asm volatile ("movl %0, %%eax\n": :"m" (function));
+	asm volatile ("int $0x94\n");
+
+	asm volatile ("movl %%eax, %0\n": "=m" (ret));
+	asm volatile ("movl %%ecx, %0\n": "=m" (w0));
+	asm volatile ("movl %%edx, %0\n": "=m" (w1));
+	asm volatile ("movl %%esi, %0\n": "=m" (w2));
+	msg->w[0] = w0; msg->w[1] = w1; msg->w[2] = w2;
+	return ret;
+}
+
+uint32_t ipc_send(uint32_t dest, IPC_MSG *msg) { // SYSTEM CALL
+	return ipc_syscall(SYSCALL_IPC_SEND, dest, msg);
+}
+
+uint32_t ipc_receive(uint32_t from, IPC_MSG *msg) { // SYSTEM CALL
+	return ipc_syscall(SYSCALL_IPC_RECEIVE, from, msg);
+}
+
+uint32_t ipc_call(uint32_t dest, IPC_MSG *msg) { // SYSTEM CALL
+	return ipc_syscall(SYSCALL_IPC_CALL, dest, msg);
+}
+
+uint32_t ipc_reply(uint32_t dest, IPC_MSG *msg) { // SYSTEM CALL
+	return ipc_syscall(SYSCALL_IPC_REPLY, dest, msg);
+}
+
+uint32_t ipc_reply_wait(uint32_t dest, IPC_MSG *msg) { // SYSTEM CALL
+	return ipc_syscall(SYSCALL_IPC_REPLY_WAIT, dest, msg);
+}
+
+/*** Futex functions ***/
+// Wait while the word at <addr> has the value <value>; returns
+// FALSE if the value had already changed
+bool fwait(volatile uint32_t *addr, uint32_t value) { // SYSTEM CALL
+	bool ret;
+
+	asm volatile ("movl %0, %%ebx\n": :"m" (addr));
+	asm volatile ("movl %0, %%ecx\n": :"m" (value));
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_FUTEX_WAIT)); // futex wait function
+	asm volatile ("int $0x94\n");
 
+	asm volatile ("movl %%edx, %0\n": "=m" (ret));
+	return ret;
+}
+
+// Wake up at most <n> processes waiting on the word at <addr>;
+// returns the number of processes woken up
+uint32_t fwake(volatile uint32_t *addr, uint32_t n) { // SYSTEM CALL
+	uint32_t ret;
+
+	asm volatile ("movl %0, %%ebx\n": :"m" (addr));
+	asm volatile ("movl %0, %%ecx\n": :"m" (n));
+	asm volatile ("movl %0, %%eax\n": :"i" (SYSCALL_FUTEX_WAKE)); // futex wake function
+	asm volatile ("int $0x94\n");
+
+	asm volatile ("movl %%edx, %0\n": "=m" (ret));
+	return ret;
+}
+
+/*** Futex based mutex ***/
+void fminit(fmutex_t *m) {
+	m->state = 0;
+}
+
+// Uncontended lock is a single compare-and-exchange; on contention
+// the state is set to 2 so that the unlocking process knows it has
+// to wake up a waiter
+void fmlock(fmutex_t *m) {
+	uint32_t c = atomic_cmpxchg(&m->state, 0, 1);
+
+	if (c == 0) return; // lock obtained
+
+	if (c != 2) c = atomic_xchg(&m->state, 2);
+	while (c != 0) {
+		fwait(&m->state, 2);
+		c = atomic_xchg(&m->state, 2);
+	}
+}
+
+void fmunlock(fmutex_t *m) {
+	if (atomic_add(&m->state, -1) != 1) { // there may be waiters
+		m->state = 0;
+		fwake(&m->state, 1);
+	}
+}
+
+/*** Futex based semaphore ***/
+void fsinit(fsem_t *s, uint32_t init_value) {
+	s->value = init_value;
+	s->waiters = 0;
+}
+
+void fsdown(fsem_t *s) {
+	uint32_t v;
+
+	while (TRUE) {
+		v = s->value;
+		if (v > 0) {
+			if (atomic_cmpxchg(&s->value, v, v-1) == v) return; // obtained
+			continue;
+		}
+
+		atomic_add(&s->waiters, 1);
+		fwait(&s->value, 0); // returns at once if an UP happened in the meantime
+		atomic_add(&s->waiters, -1);
+	}
+}
+
+void fsup(fsem_t *s) {
+	atomic_add(&s->value, 1);
+	if (s->waiters != 0) fwake(&s->value, 1);
+}
+
+/*** Ring buffer ***/
+// Bytes needed for a ring of n_slots slots
+uint32_t ring_size(uint32_t n_slots) {
+	return sizeof(RING) + n_slots*sizeof(RING_SLOT);
+}
+
+// n_slots must be a power of two
+void ring_init(RING *r, uint32_t n_slots) {
+	uint32_t i;
+
+	r->head = 0;
+	r->tail = 0;
+	r->get_event = 0;
+	r->get_waiters = 0;
+	r->put_event = 0;
+	r->put_waiters = 0;
+	r->mask = n_slots - 1;
+	for (i=0; i<n_slots; i++) r->slot[i].seq = i;
+}
+
+// Single producer: only the producer writes tail
+bool spsc_tryput(RING *r, uint32_t value) {
+	uint32_t tail = r->tail;
+
+	if (tail - r->head > r->mask) return FALSE; // full
+
+	r->slot[tail & r->mask].value = value;
+	r->tail = tail + 1; // value is visible before tail (x86 keeps store order)
+	return TRUE;
+}
+
+// Single consumer: only the consumer writes head
+bool spsc_tryget(RING *r, uint32_t *value) {
+	uint32_t head = r->head;
+
+	if (head == r->tail) return FALSE; // empty
+
+	*value = r->slot[head & r->mask].value;
+	r->head = head + 1;
+	return TRUE;
+}
+
+// Multiple producers: a slot is claimed by moving tail with a
+// compare-and-exchange; the slot's sequence number tells whether it
+// is free (seq == position) or still holds an unread value
+bool mpmc_tryput(RING *r, uint32_t value) {
+	RING_SLOT *s;
+	uint32_t pos = r->tail;
+	int diff;
+
+	while (TRUE) {
+		s = &r->slot[pos & r->mask];
+		diff = (int)(s->seq - pos);
+		if (diff == 0) {
+			if (atomic_cmpxchg(&r->tail, pos, pos+1) == pos) break; // slot claimed
+			pos = r->tail;
+		}
+		else if (diff < 0) return FALSE; // full
+		else pos = r->tail; // another producer got it
+	}
+
+	s->value = value;
+	s->seq = pos + 1; // readable now
+	return TRUE;
+}
+
+// Multiple consumers: a slot is readable when seq == position + 1;
+// after reading, seq is moved one lap ahead so that it is free for
+// the producer of the next lap
+bool mpmc_tryget(RING *r, uint32_t *value) {
+	RING_SLOT *s;
+	uint32_t pos = r->head;
+	int diff;
+
+	while (TRUE) {
+		s = &r->slot[pos & r->mask];
+		diff = (int)(s->seq - (pos+1));
+		if (diff == 0) {
+			if (atomic_cmpxchg(&r->head, pos, pos+1) == pos) break; // slot claimed
+			pos = r->head;
+		}
+		else if (diff < 0) return FALSE; // empty
+		else pos = r->head; // another consumer got it
+	}
+
+	*value = s->value;
+	s->seq = pos + r->mask + 1; // free for next lap
+	return TRUE;
+}
+
+void spsc_put(RING *r, uint32_t value) {
+	ring_put_wait(r, value, spsc_tryput);
+}
+
+uint32_t spsc_get(RING *r) {
+	return ring_get_wait(r, spsc_tryget);
+}
+
+void mpmc_put(RING *r, uint32_t value) {
+	ring_put_wait(r, value, mpmc_tryput);
+}
+
+uint32_t mpmc_get(RING *r) {
+	return ring_get_wait(r, mpmc_tryget);
+}
+
+// Blocking put: sleeps on put_event while the ring is full; the
+// waiter count is announced before trying again, so a consumer 
+// that takes a value in between either sees the waiter and changes
+// put_event (fwait returns at once), or the retry succeeds
+void ring_put_wait(RING *r, uint32_t value, bool (*tryput)(RING *, uint32_t)) {
+	uint32_t event;
+
+	while (!tryput(r, value)) {
+		atomic_add(&r->put_waiters, 1);
+		event = r->put_event;
+		if (tryput(r, value)) {
+			atomic_add(&r->put_waiters, -1);
+			break;
+		}
+		fwait(&r->put_event, event);
+		atomic_add(&r->put_waiters, -1);
+	}
+
+	memory_barrier(); // value published before waiters are checked
+	if (r->get_waiters != 0) {
+		atomic_add(&r->get_event, 1);
+		fwake(&r->get_event, 1);
+	}
+}
+
+// Blocking get: sleeps on get_event while the ring is empty
+uint32_t ring_get_wait(RING *r, bool (*tryget)(RING *, uint32_t *)) {
+	uint32_t value;
+	uint32_t event;
+
+	while (!tryget(r, &value)) {
+		atomic_add(&r->get_waiters, 1);
+		event = r->get_event;
+		if (tryget(r, &value)) {
+			atomic_add(&r->get_waiters, -1);
+			break;
+		}
+		fwait(&r->get_event, event);
+		atomic_add(&r->get_waiters, -1);
+	}
+
+	memory_barrier(); // slot freed before waiters are checked
+	if (r->put_waiters != 0) {
+		atomic_add(&r->put_event, 1);
+		fwake(&r->put_event, 1);
+	}
+
+	return value;
+}
+
+/*** Atomic operations ***/
+// Stores <new> at <addr> if it contains <old>; returns the value
+// that was at <addr>
+uint32_t atomic_cmpxchg(volatile uint32_t *addr, uint32_t old, uint32_t new) {
+	uint32_t prev;
+
+	asm volatile ("lock cmpxchgl %2, %1\n"
+		      : "=a" (prev), "+m" (*addr)
+		      : "r" (new), "0" (old)
+		      : "memory");
+	return prev;
+}
+
+// Stores <value> at <addr>; returns the old value
+uint32_t atomic_xchg(volatile uint32_t *addr, uint32_t value) {
+	asm volatile ("xchgl %0, %1\n"
+		      : "+r" (value), "+m" (*addr)
+		      :
+		      : "memory");
+	return value;
+}
+
+// Adds <value> to the word at <addr>; returns the old value
+uint32_t atomic_add(volatile uint32_t *addr, uint32_t value) {
+	asm volatile ("lock xaddl %0, %1\n"
+		      : "+r" (value), "+m" (*addr)
+		      :
+		      : "memory");
+	return value;
+}
+
+// Full memory barrier (orders earlier stores before later loads)
+void memory_barrier(void) {
+	asm volatile ("lock addl $0, (%%esp)\n": : :"memory");
+}
@@ -35,11 +35,64 @@ typedef __builtin_va_list va_list;
 #define SYSCALL_SHM_CREATE	12
 #define SYSCALL_SHM_ATTACH	13
 #define SYSCALL_SHM_DETACH	14
+#define SYSCALL_FUTEX_WAIT	15
+#define SYSCALL_FUTEX_WAKE	16
+#define SYSCALL_SET_PRIORITY	17
+#define SYSCALL_COND_CREATE	18
+#define SYSCALL_COND_DESTROY	19
+#define SYSCALL_COND_WAIT	20
+#define SYSCALL_COND_SIGNAL	21
+#define SYSCALL_COND_BROADCAST	22
+#define SYSCALL_RWLOCK_CREATE	23
+#define SYSCALL_RWLOCK_DESTROY	24
+#define SYSCALL_RWLOCK_LOCK	25
+#define SYSCALL_RWLOCK_UNLOCK	26
+#define SYSCALL_SEM_DOWN_TIMEOUT	27
+#define SYSCALL_SEM_UP_N	28
+#define SYSCALL_SEM_DOWN_N	29
+#define SYSCALL_PIPE_CREATE	30
+#define SYSCALL_PIPE_ATTACH	31
+#define SYSCALL_PIPE_DETACH	32
+#define SYSCALL_PIPE_READ	33
+#define SYSCALL_PIPE_WRITE	34
+#define SYSCALL_WAIT_ANY	35
+#define SYSCALL_SHM_OPEN	36
+#define SYSCALL_SHM_UNLINK	37
+#define SYSCALL_GETPID		38
+#define SYSCALL_IPC_SEND	39
+#define SYSCALL_IPC_RECEIVE	40
+#define SYSCALL_IPC_CALL	41
+#define SYSCALL_IPC_REPLY	42
+#define SYSCALL_IPC_REPLY_WAIT	43
+#define SYSCALL_BARRIER_CREATE	44
+#define SYSCALL_BARRIER_DESTROY	45
+#define SYSCALL_BARRIER_WAIT	46
+#define SYSCALL_UPTIME		47
 	
 /*** Shared memory access ***/
 #define SM_READ_ONLY		0x00000000
 #define SM_READ_WRITE		0x00000002
 
+/*** Pipe ends ***/
+#define PIPE_READ_END		1
+#define PIPE_WRITE_END		2
+
+/*** Wait on multiple objects ***/
+#define WAIT_SEMAPHORE		1	// DOWN on semaphore
+#define WAIT_MUTEX		2	// lock on mutex
+#define WAIT_PIPE		3	// input pipe readable (key not used)
+#define WAIT_TIMEOUT		0xFFFFFFFF	// wait_any: timeout was over
+#define WAIT_ERROR		0xFFFFFFFE	// wait_any: invalid set of objects
+
+/*** Barrier wait results ***/
+#define BARRIER_SERIAL		1		// bwait: last process to arrive
+#define BARRIER_ERROR		0xFFFFFFFF	// bwait: no such barrier, or destroyed
+
+/*** Message passing ***/
+#define IPC_WORDS		3		// words in a message (carried in registers)
+#define IPC_ANY			0xFFFFFFFF	// receive from any process
+#define IPC_ERROR		0xFFFFFFFE	// no such process, or it has ended
+
 #define NULL 0
 
 typedef unsigned long long uint64_t;
@@ -47,8 +100,62 @@ typedef unsigned uint32_t;
 typedef unsigned short uint16_t;
 typedef unsigned char uint8_t;
 typedef enum {FALSE=0, TRUE=1} bool;
-typedef unsigned char mutex_t;
-typedef unsigned char sem_t;
+typedef unsigned mutex_t;
+typedef unsigned sem_t;
+typedef unsigned barrier_t;
+typedef unsigned cond_t;
+typedef unsigned rwlock_t;
+typedef unsigned char pipe_t;
+
+typedef struct {
+	uint32_t type;		// WAIT_SEMAPHORE, WAIT_MUTEX or WAIT_PIPE
+	uint32_t key;		// semaphore or mutex key
+} WAIT_OBJECT;
+
+typedef struct {
+	uint32_t w[IPC_WORDS];
+} IPC_MSG;
+
+/*** Futex based synchronization (user-space fast path) ***/
+// Objects are placed in (shared) memory and initialized with
+// fminit/fsinit; the kernel is called only on contention
+typedef struct {
+	volatile uint32_t state;	// 0: unlocked; 1: locked; 2: locked, may have waiters
+} fmutex_t;
+
+typedef struct {
+	volatile uint32_t value;	// current value of semaphore
+	volatile uint32_t waiters;	// number of processes (about to be) waiting
+} fsem_t;
+
+/*** Ring buffer (lock-free, in shared memory) ***/
+// A ring of 32-bit values for single-producer/single-consumer (spsc_*)
+// or multi-producer/multi-consumer (mpmc_*) use; the number of slots
+// must be a power of two and the ring must start at a 64-byte boundary
+// (e.g. beginning of a shared memory area) of ring_size() bytes.
+// Indices are kept in separate cache lines so that producers and
+// consumers do not invalidate each other's lines; processes sleep 
+// (futex) only when the ring is empty/full
+#define CACHE_LINE	64
+
+typedef struct {
+	volatile uint32_t seq;		// sequence number (mpmc only)
+	uint32_t value;
+} RING_SLOT;
+
+typedef struct {
+	volatile uint32_t head;		// next slot to read
+	uint8_t pad_head[CACHE_LINE-4];
+	volatile uint32_t tail;		// next slot to write
+	uint8_t pad_tail[CACHE_LINE-4];
+	volatile uint32_t get_event;	// changed when a value is put and consumers wait
+	volatile uint32_t get_waiters;	// number of consumers (about to be) waiting
+	volatile uint32_t put_event;	// changed when a value is taken and producers wait
+	volatile uint32_t put_waiters;	// number of producers (about to be) waiting
+	uint32_t mask;			// number of slots - 1
+	uint8_t pad_sync[CACHE_LINE-20];
+	RING_SLOT slot[];
+} RING;
 
 /*** Codes for the keyboard keys ***/
 typedef enum {
@@ -154,12 +261,74 @@ sem_t screate(uint8_t);
 void sdestroy(sem_t);
 void sdown(sem_t);
 void sup(sem_t);
+bool sdown_timeout(sem_t, uint32_t);
+void sup_n(sem_t, uint32_t);
+void sdown_n(sem_t, uint32_t);
+barrier_t bcreate(uint32_t);
+void bdestroy(barrier_t);
+uint32_t bwait(barrier_t);
+cond_t ccreate(void);
+void cdestroy(cond_t);
+bool cwait(cond_t, mutex_t);
+void csignal(cond_t);
+void cbroadcast(cond_t);
+rwlock_t rwcreate(void);
+void rwdestroy(rwlock_t);
+bool rdlock(rwlock_t);
+bool wrlock(rwlock_t);
+bool rwunlock(rwlock_t);
+pipe_t pcreate(void);
+bool pattach(pipe_t, uint32_t);
+void pdetach(uint32_t);
+uint32_t pread(void *, uint32_t);
+uint32_t pwrite(void *, uint32_t);
+uint32_t wait_any(WAIT_OBJECT *, uint32_t, uint32_t);
 void *smcreate(uint8_t, uint32_t);
+void *smcreate_at(uint8_t, uint32_t, void *);
 void *smattach(uint8_t, uint32_t);
-void smdetach();
+void *smattach_at(uint8_t, uint32_t, void *);
+bool smdetach(void *);
+void *smopen(char *, uint32_t, uint32_t);
+bool smunlink(char *);
+uint32_t getpid(void);
+uint32_t ipc_send(uint32_t, IPC_MSG *);
+uint32_t ipc_receive(uint32_t, IPC_MSG *);
+uint32_t ipc_call(uint32_t, IPC_MSG *);
+uint32_t ipc_reply(uint32_t, IPC_MSG *);
+uint32_t ipc_reply_wait(uint32_t, IPC_MSG *);
+bool fwait(volatile uint32_t *, uint32_t);
+uint32_t fwake(volatile uint32_t *, uint32_t);
+void fminit(fmutex_t *);
+void fmlock(fmutex_t *);
+void fmunlock(fmutex_t *);
+void fsinit(fsem_t *, uint32_t);
+void fsdown(fsem_t *);
+void fsup(fsem_t *);
+
+/*** Ring buffer functions ***/
+uint32_t ring_size(uint32_t);
+void ring_init(RING *, uint32_t);
+bool spsc_tryput(RING *, uint32_t);
+bool spsc_tryget(RING *, uint32_t *);
+bool mpmc_tryput(RING *, uint32_t);
+bool mpmc_tryget(RING *, uint32_t *);
+void spsc_put(RING *, uint32_t);
+uint32_t spsc_get(RING *);
+void mpmc_put(RING *, uint32_t);
+uint32_t mpmc_get(RING *);
+void ring_put_wait(RING *, uint32_t, bool (*)(RING *, uint32_t));
+uint32_t ring_get_wait(RING *, bool (*)(RING *, uint32_t *));
+
+/*** Atomic operations ***/
+uint32_t atomic_cmpxchg(volatile uint32_t *, uint32_t, uint32_t);
+uint32_t atomic_xchg(volatile uint32_t *, uint32_t);
+uint32_t atomic_add(volatile uint32_t *, uint32_t);
+void memory_barrier(void);
 
 
 /*** Other functions ***/
 void sleep(uint32_t);
+uint32_t uptime(void);
+void setpriority(uint8_t);
 
 
@@ -5,6 +5,8 @@
 
 #include "kernel_only.h"
 
+extern uint32_t total_frames;	// from pmemman.c
+
 // kernel page directory will be placed at frame 257
 PDE *k_page_directory = (PDE *)(0xC0101000); 
 // page table entries for the 768th page directory entry will be placed
@@ -12,6 +14,15 @@ PDE *k_page_directory = (PDE *)(0xC0101000);
 // 3GB to 3GB+4MB-1 (0xC0000000 to 0xC03FFFFF)
 PTE *pages_768 = (PTE *)(0xC0102000); 
 
+// a kernel page used to hold page contents while a copy-on-write
+// page is being replaced by a private copy
+uint32_t *page_buffer = NULL;
+
+// page table for the 767th page directory entry (kernel only); its
+// first entry maps KERNEL_TEMP_MAP to any frame (see map_frame) so
+// that the kernel can access frames above the first 4MB
+PTE *temp_pages = NULL;
+
 /*** Initialize logical memory for a process ***/
 // Allocates physical memory and sets up page tables;
 // we need to allocate memory to hold the program code and
@@ -19,14 +30,69 @@ PTE *pages_768 = (PTE *)(0xC0102000);
 // page tables
 // called by runprogram.c; this function does not load the 
 // program from disk to memory (done in scheduler.c)
+// The program image frames are shared with other processes running
+// the same program; they are mapped read-only and copy-on-write,
+// so only the stack gets private frames here
+
+bool init_logical_memory(PCB *p, IMAGE *image) {
+	uint32_t i;
+
+	// frames for the stack; the topmost stack frame is the kernel-mode
+	// stack used during system calls; the user stack starts small and
+	// grows on demand (see grow_stack)
+	uint32_t stack_frames[1+USER_STACK_INIT_PAGES];
+	if (!alloc_frames_scattered(1+USER_STACK_INIT_PAGES, stack_frames)) return FALSE;
+
+	// how many page tables are needed to map the image
+	uint32_t n_pt = image->n_pages / 1024; // one page table maps 1024 pages 
+	if (image->n_pages % 1024 != 0) n_pt++;
+
+	// one frame for page directory, n_pt frames for image page tables
+	// and one frame for the stack page table
+	uint32_t pd_frame = (uint32_t)alloc_frames(n_pt+2, KERNEL_ALLOC);
+	if (pd_frame == NULL) {
+		dealloc_frames_scattered(stack_frames, 1+USER_STACK_INIT_PAGES);
+		return FALSE;
+	}
+
+	// logical address pointers of page directory and page tables
+	PDE *page_directory = (PDE *)(pd_frame + KERNEL_BASE);
+	PTE *l_pages = (PTE *)(pd_frame + 4096 + KERNEL_BASE);
+	PTE *l_stack_pages = l_pages + n_pt*1024;
+
+	zero_out_pages((void *)page_directory, n_pt+2);
 
-/** DO NOT UNCOMMENT THE FOLLOWING **/
-/*
-bool init_logical_memory(PCB *p, uint32_t code_size) {
-	// you implemented this in a previous assignment
-	...
+	// program image (code and data): logical address 0 onwards
+	for (i=0; i<image->n_pages; i++) {
+		if (i % 1024 == 0) // first time use of page table
+			page_directory[i/1024] = (pd_frame + 4096*(i/1024 + 1)) | PDE_PRESENT | PDE_READ_WRITE | PDE_USER_SUPERVISOR;
+		l_pages[i] = image->frames[i] | PTE_COPY_ON_WRITE | PTE_PRESENT | PTE_USER_SUPERVISOR;
+		ref_frames((void *)image->frames[i], 1); // one more mapping of the frame
+	}
+
+	// stack: the page table maps 0xBF800000 to 0xBFBFFFFF; last page is the
+	// kernel-mode stack (see setup_TSS) and the ones below it the user stack
+	page_directory[766] = (pd_frame + 4096*(n_pt + 1)) | PDE_PRESENT | PDE_READ_WRITE | PDE_USER_SUPERVISOR;
+	l_stack_pages[1023] = stack_frames[0] | PTE_PRESENT | PTE_READ_WRITE;
+	for (i=1; i<=USER_STACK_INIT_PAGES; i++)
+		l_stack_pages[1023-i] = stack_frames[i] | PTE_PRESENT | PTE_READ_WRITE | PTE_USER_SUPERVISOR;
+
+	// kernel: the 767th and 768th page directory entries are shared by 
+	// all processes
+	page_directory[767] = k_page_directory[767];
+	page_directory[768] = k_page_directory[768];
+
+	p->mem.start_code = 0;
+	p->mem.end_code = image->n_sectors*512 - 1;
+	p->mem.start_brk = image->n_pages*4096; // heap begins after image
+	p->mem.brk = p->mem.start_brk;
+	p->mem.start_stack = 0xBFBFEFFF;
+	p->mem.end_stack = USER_STACK_TOP - USER_STACK_INIT_PAGES*4096;
+	p->mem.page_directory = (PDE *)pd_frame; // physical address (loaded in CR3)
+	p->mem.image = image;
+
+	return TRUE;
 }
-*/
 
 /*** Initialize kernel's page directory and table ***/
 void init_kernel_pages(void) {
@@ -42,6 +108,43 @@ void init_kernel_pages(void) {
 
 	// load page directory
 	load_CR3((uint32_t)k_page_directory-KERNEL_BASE);
+
+	page_buffer = (uint32_t *)alloc_kernel_pages(1);
+
+	temp_pages = (PTE *)alloc_kernel_pages(1);
+	zero_out_pages((void *)temp_pages, 1);
+	k_page_directory[767] = ((uint32_t)temp_pages-KERNEL_BASE) | PDE_PRESENT | PDE_READ_WRITE;
+}
+
+/*** Make a frame accessible to the kernel ***/
+// Maps the frame at physical address <frame> at KERNEL_TEMP_MAP and
+// returns the address; the mapping is valid until the next call, so
+// this must be used with interrupts disabled
+void *map_frame(uint32_t frame) {
+	temp_pages[0] = (frame & 0xFFFFF000) | PTE_PRESENT | PTE_READ_WRITE;
+	invalidate_page(KERNEL_TEMP_MAP);
+	return (void *)KERNEL_TEMP_MAP;
+}
+
+/*** Page table entry of a user page ***/
+// Returns the page table entry of logical address <loc> in process p;
+// NULL if there is no page table for the address
+PTE *get_pte(PCB *p, uint32_t loc) {
+	PDE *page_directory = (PDE *)((uint32_t)p->mem.page_directory + KERNEL_BASE);
+	uint32_t pd_entry = loc >> 22; // top 10 bits
+	uint32_t pt_entry = (loc >> 12) & 0x000003FF; // next top 10 bits 
+
+	if ((uint32_t)(page_directory[pd_entry] & PDE_PRESENT) == 0) return NULL;
+	PTE *pt = (PTE *)((page_directory[pd_entry] & 0xFFFFF000) + KERNEL_BASE);
+
+	return &pt[pt_entry];
+}
+
+/*** Check a user buffer ***/
+// Returns TRUE if the n bytes from logical address <loc> are all in 
+// the user area of virtual memory (below the kernel-mode stack)
+bool user_range_ok(uint32_t loc, uint32_t n) {
+	return (loc < USER_STACK_TOP && n <= USER_STACK_TOP - loc);
 }
 
 /*** Load CR3 with page directory ***/
@@ -50,6 +153,13 @@ void load_CR3(uint32_t pd) {
 	asm volatile ("movl %eax, %cr3\n");
 }
 
+/*** Remove TLB entry of a page ***/
+// Must be called after the page table entry of a page in the
+// current address space is changed
+void invalidate_page(uint32_t loc) {
+	asm volatile ("invlpg (%0)\n": :"r"(loc) :"memory");
+}
+
 /*** Allocate logical memory for kernel***/
 // Allocates pages for kernel and returns logical address of allocated memory
 // Note: Kernel uses 0xC0000000 to 0xC0400000 for now
@@ -75,7 +185,8 @@ void *alloc_kernel_pages(uint32_t n_pages) {
 }
 
 /*** Allocate logical memory for user ***/
-// n_pages: the number of contiguous pages requested
+// n_pages: the number of contiguous pages requested; the frames
+//          backing them need not be physically contiguous
 // base: requested base address of first page; must be 4KB aligned;
 //       all pages must fit before hitting KERNEL_BASE
 // page_directory: logical base address of process page directory
@@ -85,28 +196,26 @@ void *alloc_kernel_pages(uint32_t n_pages) {
 // if necessary
 void *alloc_user_pages(uint32_t n_pages, uint32_t base, PDE *page_directory, uint32_t mode) { 
 	// some sanity check
-	if (base & 0x00000FFF != 0 || 			// base not 4KB aligned
+	if ((base & 0x00000FFF) != 0 || 		// base not 4KB aligned
 	    base >= KERNEL_BASE ||			// base encroaching on kernel address space
 	    (KERNEL_BASE - base)/4096 < n_pages ||	// some pages on kernel address space
 	    n_pages == 0) return NULL; 
 
 	int i;
 
-	// allocate frames for the requested pages
-	uint32_t user_frames = (uint32_t)alloc_frames(n_pages, USER_ALLOC);
-	if (user_frames==NULL) return NULL;
+	// frames for the requested pages need not be contiguous, only 
+	// enough of them must be free
+	if (count_free_frames(1024,total_frames) < n_pages) return NULL;
+	uint32_t user_frames = NULL;	// next frame to map from the current run
+	uint32_t run_length = 0;	// frames left in the current run
 
 	// how many new page tables we may need; some may be returned
-	uint32_t n_pde = n_pages / 1024; // one page table maps 1024 pages 
-	if (n_pages % 1024 != 0) n_pde++;
+	uint32_t n_pde = ((base + (n_pages-1)*4096) >> 22) - (base >> 22) + 1;
 	
 	// allocate frames for the new page tables
 	uint32_t pt_frames = (uint32_t)alloc_frames(n_pde, KERNEL_ALLOC);
 	uint32_t pt_frames_used = 0; // we will track how many are used
-	if (pt_frames == NULL) {
-		dealloc_frames((void *)user_frames,n_pages);		
-		return NULL;
-	}
+	if (pt_frames == NULL) return NULL;
 	
 	// set up page directory and page tables
 	PTE *l_pages; 
@@ -125,13 +234,18 @@ void *alloc_user_pages(uint32_t n_pages, uint32_t base, PDE *page_directory, uin
 		// logical address pointer of page table
 		l_pages = (PTE *)((page_directory[pd_entry] & 0xFFFFF000) + KERNEL_BASE);
 
-		// write page table entries; if a mapping already exists, then referred frame
-		// is freed
+		// write page table entries; if a mapping already exists, then the reference
+		// to the frame is dropped
 		if ((uint32_t)(l_pages[pt_entry] & PTE_PRESENT) != 0) { // mapping already present
 			dealloc_frames((void *)(l_pages[pt_entry] & 0xFFFFF000),1);
 		}
+		// take frames from the longest free run available
+		if (run_length == 0)
+			user_frames = (uint32_t)alloc_frame_run(n_pages-i, &run_length);
+
 		l_pages[pt_entry] = user_frames | mode | PTE_PRESENT | PTE_USER_SUPERVISOR;
 		user_frames += 4096; // one page is 4KB
+		run_length--;
 
 		pt_entry++;
 		if (pt_entry == 1024) {  // time to move to next page directory entry
@@ -174,30 +288,122 @@ void dealloc_page(void *loc, PDE *p) {
 /*** Deallocate all pages ***/
 // Traverses the page directory and deallocs all allocated
 // pages; p is the virtual address of page directory
+// Physically contiguous frames are returned with a single
+// dealloc_frames call; shared frames (program image, shared
+// memory) are freed only when their last reference is dropped
 void dealloc_all_pages(PDE *p) {
 	uint32_t pd_entry;
-	uint32_t pt_entry;
 	uint32_t i;
-	uint32_t loc = 0;
+	uint32_t frame;
+	uint32_t run_base = 0;		// first frame of a run of contiguous frames
+	uint32_t run_length = 0;	// number of frames in the run
 	PTE *pt;
 
-	while (loc < 0xC0000000) { // only freeing user area of virtual memory
-		pd_entry = loc >> 22; // top 10 bits
+	for (pd_entry=0; pd_entry<767; pd_entry++) { // only freeing user area of virtual memory
+		if (p[pd_entry] == 0) continue; // page directory entry does not exist
 
-		if (p[pd_entry] != 0) { // page directory entry exists
-			pt = (PTE *)((p[pd_entry] & 0xFFFFF000) + KERNEL_BASE);
-			for (i=0; i<1024; i++) { // walk through page table
-				if (pt[i] == 0) continue;
-				dealloc_page((void *)(loc + i*4096), p);
-			}
+		pt = (PTE *)((p[pd_entry] & 0xFFFFF000) + KERNEL_BASE);
+		for (i=0; i<1024; i++) { // walk through page table
+			if (pt[i] == 0) continue;
 
-			// dealloc page table space and mark page directory entry not present
-			dealloc_frames((void *)(p[pd_entry] & 0xFFFFF000), 1);
-			p[pd_entry] = 0;
+			frame = pt[i] & 0xFFFFF000;
+			if (run_length != 0 && frame == run_base + run_length*4096) 
+				run_length++; // extends the current run
+			else {
+				if (run_length != 0) dealloc_frames((void *)run_base, run_length);
+				run_base = frame;
+				run_length = 1;
+			}
+			pt[i] = 0;
 		}
-		
-		loc += 0x400000; // move ahead 4MB; the next page table
+
+		// dealloc page table space and mark page directory entry not present
+		dealloc_frames((void *)(p[pd_entry] & 0xFFFFF000), 1);
+		p[pd_entry] = 0;
+	}
+
+	if (run_length != 0) dealloc_frames((void *)run_base, run_length);
+}
+
+/*** Resolve a page fault ***/
+// Returns TRUE if the fault at logical address <loc> of process
+// p was resolved and the faulting instruction can be restarted;
+// error_code is the one pushed by the CPU and esp the user stack
+// pointer at the time of the fault
+bool resolve_page_fault(PCB *p, uint32_t loc, uint32_t error_code, uint32_t esp) {
+	if (loc >= KERNEL_BASE) return FALSE;
+
+	PDE *page_directory = (PDE *)((uint32_t)p->mem.page_directory + KERNEL_BASE);
+	uint32_t pd_entry = loc >> 22; // top 10 bits
+	uint32_t pt_entry = (loc >> 12) & 0x000003FF; // next top 10 bits 
+
+	if ((uint32_t)(page_directory[pd_entry] & PDE_PRESENT) == 0) return FALSE;
+	PTE *pt = (PTE *)((page_directory[pd_entry] & 0xFFFFF000) + KERNEL_BASE);
+
+	// write to a shared page
+	if ((error_code & PF_PROTECTION) && (error_code & PF_WRITE) &&
+	    (pt[pt_entry] & PTE_COPY_ON_WRITE))
+		return copy_on_write(&pt[pt_entry], loc & 0xFFFFF000);
+
+	// access below the mapped stack but not below the stack pointer (a
+	// PUSHA writes up to 32 bytes below it): stack needs to grow; the
+	// guard page below USER_STACK_MAX_PAGES is never given
+	if ((error_code & PF_PROTECTION) == 0 && loc < p->mem.end_stack && 
+	    loc >= USER_STACK_TOP - USER_STACK_MAX_PAGES*4096 && loc + 32 >= esp)
+		return grow_stack(p, loc);
+
+	return FALSE;
+}
+
+/*** Grow the user stack of process p to include address <loc> ***/
+// Pages are mapped from the page of <loc> up to the currently
+// mapped stack; stack is in the current address space
+bool grow_stack(PCB *p, uint32_t loc) {
+	PDE *page_directory = (PDE *)((uint32_t)p->mem.page_directory + KERNEL_BASE);
+	PTE *pt = (PTE *)((page_directory[766] & 0xFFFFF000) + KERNEL_BASE); // stack page table
+	uint32_t frame;
+
+	while (p->mem.end_stack > (loc & 0xFFFFF000)) {
+		frame = (uint32_t)alloc_frames(1, USER_ALLOC);
+		if (frame == NULL) return FALSE;
+
+		p->mem.end_stack -= 4096;
+		pt[(p->mem.end_stack >> 12) & 0x000003FF] = frame | PTE_PRESENT | PTE_READ_WRITE | PTE_USER_SUPERVISOR;
+		invalidate_page(p->mem.end_stack);
+		zero_out_pages((void *)p->mem.end_stack, 1);
 	}
+
+	return TRUE;
+}
+
+/*** Give a private copy of a shared page ***/
+// pte is the page table entry of the page at logical address <page>
+// in the current address space; if this is the only reference to
+// the frame, it is simply made writable
+bool copy_on_write(PTE *pte, uint32_t page) {
+	int i;
+	uint32_t old_frame = *pte & 0xFFFFF000;
+
+	if (get_frame_refs((void *)old_frame) == 1) {
+		*pte = old_frame | PTE_PRESENT | PTE_READ_WRITE | PTE_USER_SUPERVISOR;
+		set_frame_type((void *)old_frame, 1, FRAME_USER);
+		invalidate_page(page);
+		return TRUE;
+	}
+
+	uint32_t frame = (uint32_t)alloc_frames(1, USER_ALLOC);
+	if (frame == NULL) return FALSE;
+
+	for (i=0; i<1024; i++) page_buffer[i] = ((uint32_t *)page)[i];
+
+	*pte = frame | PTE_PRESENT | PTE_READ_WRITE | PTE_USER_SUPERVISOR;
+	invalidate_page(page);
+
+	for (i=0; i<1024; i++) ((uint32_t *)page)[i] = page_buffer[i];
+
+	dealloc_frames((void *)old_frame, 1); // drop reference to the shared frame
+
+	return TRUE;
 }
 
 /*** Zero out pages ***/
@@ -205,7 +411,7 @@ void dealloc_all_pages(PDE *p) {
 void zero_out_pages(void *base, uint32_t n_pages) {
 	int i=0;
 	for (i=0; i<1024*n_pages; i++)
-		*((uint32_t *)((uint32_t)base + i)) = 0;
+		((uint32_t *)base)[i] = 0;
 }
 
 
@@ -0,0 +1,33 @@
+///////////////////////////////////////////////////////
+// Lock contention statistics
+// Mutexes and semaphores count how often they were obtained, how
+// often the process had to wait for them, and how long (in epochs,
+// see timer.c) it waited; the console command lockstat lists the
+// most contended ones
+// A waiting time is taken from the time stamp enqueue (queue.c)
+// puts in the wait node of the process
+
+#include "kernel_only.h"
+
+/*** Clear statistics ***/
+void reset_lock_stats(LOCK_STATS *s) {
+	s->acquired = 0;
+	s->contended = 0;
+	s->wait_total = 0;
+	s->wait_max = 0;
+}
+
+/*** Record that a lock was obtained ***/
+// <waited> is the wait node of the process if it had to wait;
+// NULL if it got the lock at once
+void lock_acquired(LOCK_STATS *s, WAIT_NODE *waited) {
+	uint32_t t;
+
+	s->acquired++;
+	if (waited == NULL) return;
+
+	t = get_epochs() - waited->since;
+	s->contended++;
+	s->wait_total += t;
+	if (t > s->wait_max) s->wait_max = t;
+}
@@ -12,19 +12,27 @@
 
 int main(void) {
 
-	init_disk();
 	init_display();
 	init_interrupts();	
+	init_disk();
 	init_keyboard();
 	init_physical_memory_manager();
 	init_kernel_pages();
+	init_disk_dma();
+	init_cache();
 	init_scheduler();
 	init_timer();
 	init_system_calls();	
 	init_exceptions();
 	init_mutexes();
 	init_semaphores();
+	init_barriers();
+	init_conditions();
+	init_rwlocks();
+	init_futexes();
 	init_shared_memory();
+	init_pipes();
+	init_images();
 
 	enable_interrupts();
 
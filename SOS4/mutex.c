@@ -1,129 +1,288 @@
-///////////////////////////////////////////////////////
-// Mutex implementation
-// This implementation provides MUTEX_MAXNUMBER mutex locks
-// for use by user processes; the lock number is specified 
-// using an 8-bit number (called key), which restricts us to 
-// have up to 256 mutex variables
-// DO NOT use a mutex object that has not been created; the functions
-// always return in such cases
-// TODO: Allow user process to create own mutex object
-
-#include "kernel_only.h"
-
-MUTEX mx[MUTEX_MAXNUMBER];	// the mutex locks; maximum 256 of them
-
-/*** Initialize all mutex objects ***/
-void init_mutexes() {
-	int i;
-	for (i=0; i<MUTEX_MAXNUMBER; i++) {
-		mx[i].available = TRUE; // the mutex is available for use
-		mx[i].lock_with = NULL;
-		init_queue(&(mx[i].waitq));
-	}
-	mx[0].available = FALSE;
-}
-
-/*** Create a mutex object ***/
-// At least one of the cooperating processes (typically
-// the main process) should create the mutex before use
-// The function returns 0 if no mutex objects are available;
-// otherwise the mutex object number is returned
-mutex_t mutex_create(PCB *p) {
-	// TODO: see background material on what this function should do
-
-	mutex_t m = 0;
-	for (m = 0; m < 256; m++){
-		if (mx[(uint32_t)m].available == TRUE){
-			mx[(uint32_t)m].available = FALSE;
-			mx[(uint32_t)m].creator = p->pid;
-			mx[(uint32_t)m].lock_with = NULL;
-			QUEUE *q = &mx[(uint32_t)m].waitq;
-			init_queue(q);
-			return m;
-		}
-	}
-	return 0;
-
-	// TODO: comment the following line before you start working
-	//return 0;
-}
-
-/*** Destroy a mutex with a given key ***/
-// This should be called by the process who created the mutex
-// using mutex_create; the function makes the mutex key available
-// for use by other creators.
-// Mutex is automatically destroyed if creator process dies; creator
-// process should always destroy a mutex when no other process is
-// holding a lock on it; otherwise the behavior is undefined
-void mutex_destroy(mutex_t key, PCB *p) {
-	// TODO: see background material on what this function should do
-	if (mx[(uint32_t)key].creator == p->pid) {
-		mx[(uint32_t)key].available = TRUE;
-	}
-}
-
-/*** Obtain lock on mutex ***/
-// Return true if process p is able to obtain a lock on mutex
-// number <key>; otherwise the process is queued and FALSE is
-// returned.
-// Non-recursive: if the process holding the lock tries
-// to obtain the lock again, it will cause a deadlock
-bool mutex_lock(mutex_t key, PCB *p) {
-	// TODO: see background material on what this function should do
-
-	if (mx[(uint32_t)key].lock_with == NULL){
-		mx[(uint32_t)key].available == FALSE;
-		mx[(uint32_t)key].lock_with = p;
-		p->mutex.wait_on = -1;
-		return TRUE;
-	}
-	else{
-		QUEUE *q = &mx[(uint32_t)key].waitq;
-		p->mutex.queue_index = enqueue(q, p);
-		p->mutex.wait_on = (uint32_t)key;
-		return FALSE;
-	}
-
-	// TODO: comment the following line before you start working
-	//return TRUE;
-}
-
-/*** Release a previously obtained lock ***/
-// Returns FALSE if lock is not owned by process p;
-// otherwise the lock is given to a waiting process and TRUE
-// is returned
-bool mutex_unlock(mutex_t key, PCB *p) {
-	// TODO: see background material on what this function should do
-
-	if (mx[(uint32_t)key].lock_with == p){
-		QUEUE *q = &mx[(uint32_t)key].waitq;
-		PCB *next_p = dequeue(q);
-		if (next_p != NULL){
-			next_p->mutex.wait_on = -1;
-			next_p->state = READY;
-		}
-		mx[(uint32_t)key].lock_with = next_p;
-		return TRUE;
-	}
-
-	return FALSE;
-	// TODO: comment the following line before you start working
-	//return TRUE;
-}
-
-/*** Cleanup mutexes for a process ***/
-void free_mutex_locks(PCB *p) {
-	int i;
-
-	for (i=1; i<MUTEX_MAXNUMBER; i++) {
-		// see if process is creator of the mutex
-		if (p->pid == mx[i].creator) mutex_destroy((mutex_t)i,p);
-	}
-
-	// remove from wait queue, if any
-	if (p->mutex.wait_on != -1) 
-		remove_queue_item(&mx[p->mutex.wait_on].waitq, p->mutex.queue_index);	
-}
-
-
-
+///////////////////////////////////////////////////////
+// Mutex implementation
+// This implementation provides mutex locks for use by user
+// processes; a mutex is specified using a 32-bit handle (called
+// key) from the mutex handle table (see handle.c), which grows as
+// more mutexes are created
+// Using a mutex that has not been created (or has been destroyed)
+// is harmless; the functions always return in such cases
+// Mutexes use priority inheritance: a process holding a mutex runs
+// at the highest priority of the processes waiting on it, and the
+// lock is handed to the highest priority waiter
+
+#include "kernel_only.h"
+
+HANDLE_TABLE mutexes;	// the mutex locks
+
+/*** Initialize mutex table ***/
+void init_mutexes() {
+	init_handle_table(&mutexes, sizeof(MUTEX));
+}
+
+/*** Mutex with a given key ***/
+// Returns NULL if there is no such mutex
+MUTEX *get_mutex(mutex_t key) {
+	return (MUTEX *)get_object(&mutexes, key);
+}
+
+/*** Create a mutex object ***/
+// At least one of the cooperating processes (typically
+// the main process) should create the mutex before use
+// The function returns 0 if no memory is available for a new
+// mutex; otherwise the key of the mutex is returned
+mutex_t mutex_create(PCB *p) {
+	MUTEX *m = (MUTEX *)alloc_object(&mutexes, p, &p->mutex.created);
+
+	if (m == NULL) return 0;
+
+	m->lock_with = NULL;
+	init_queue(&m->waitq);
+	reset_lock_stats(&m->stats);
+	return object_handle(&m->h);
+}
+
+/*** Destroy a mutex with a given key ***/
+// This should be called by the process who created the mutex
+// using mutex_create; the key becomes invalid.
+// Mutex is automatically destroyed if creator process dies; 
+// processes still waiting on it are woken up without the lock
+void mutex_destroy(mutex_t key, PCB *p) {
+	MUTEX *m = get_mutex(key);
+	WAIT_NODE *n;
+	PCB *holder;
+
+	if (m == NULL || m->h.creator != p->pid) return;
+
+	while ((n = m->waitq.head) != NULL) {
+		remove_queue_item(&m->waitq, n);
+		if (n->index != WAIT_SINGLE) wait_any_cancel(n); // in wait.c
+		else {
+			n->p->mutex.wait_on = 0;
+			n->p->state = READY;
+		}
+	}
+	holder = m->lock_with;
+	drop_mutex(m);
+	free_object(&mutexes, &m->h, &p->mutex.created);
+
+	if (holder != NULL) update_priority(holder); // drops inherited priority
+}
+
+/*** Obtain lock on mutex ***/
+// Return true if process p is able to obtain a lock on mutex
+// number <key>; otherwise the process is queued and FALSE is
+// returned.
+// Non-recursive: if the process holding the lock tries
+// to obtain the lock again, it will cause a deadlock
+bool mutex_lock(mutex_t key, PCB *p) {
+	MUTEX *m = get_mutex(key);
+
+	if (m == NULL) return TRUE; // do not wait on a mutex that does not exist
+
+	if (m->lock_with == NULL){
+		hold_mutex(m, p);
+		p->mutex.wait_on = 0;
+		lock_acquired(&m->stats, NULL);
+		return TRUE;
+	}
+	else{
+		enqueue(&m->waitq, &p->mutex.wait_node);
+		p->mutex.wait_on = key;
+
+		// holder should not be kept from running by processes of lower
+		// priority than p
+		inherit_priority(m->lock_with, p->priority.effective);
+		return FALSE;
+	}
+}
+
+/*** Release a previously obtained lock ***/
+// Returns FALSE if lock is not owned by process p;
+// otherwise the lock is given to the highest priority waiting 
+// process and TRUE is returned; p drops any priority inherited 
+// through this mutex
+bool mutex_unlock(mutex_t key, PCB *p) {
+	MUTEX *m = get_mutex(key);
+	PCB *next_p;
+
+	if (m == NULL || m->lock_with != p) return FALSE;
+
+	next_p = release_mutex(m);
+
+	update_priority(p);
+	if (next_p != NULL) {
+		update_priority(next_p); // inherits from remaining waiters
+		wakeup_handoff(p, next_p); // in scheduler.c
+	}
+	return TRUE;
+}
+
+/*** Obtain lock on mutex if it is free ***/
+// Returns FALSE (process is not queued) if the mutex is locked
+// or does not exist
+bool mutex_trylock(mutex_t key, PCB *p) {
+	MUTEX *m = get_mutex(key);
+
+	if (m == NULL || m->lock_with != NULL) return FALSE;
+
+	hold_mutex(m, p);
+	lock_acquired(&m->stats, NULL);
+	return TRUE;
+}
+
+/*** Give a locked mutex to the next holder ***/
+// The lock goes to the highest priority waiting process, which is
+// woken up; the mutex becomes free if nobody is waiting. Returns the
+// new holder (NULL if none)
+PCB *release_mutex(MUTEX *m) {
+	WAIT_NODE *next = highest_priority_waiter(&m->waitq);
+	PCB *next_p = NULL;
+
+	drop_mutex(m);
+	if (next != NULL){
+		next_p = next->p;
+		remove_queue_item(&m->waitq, next);
+		lock_acquired(&m->stats, next);
+		if (next->index != WAIT_SINGLE) wait_any_fired(next); // in wait.c
+		else {
+			next_p->mutex.wait_on = 0;
+			next_p->state = READY;
+		}
+		hold_mutex(m, next_p);
+	}
+	return next_p;
+}
+
+/*** Make process p the holder of a mutex ***/
+// The mutex is added to the list of mutexes held by p
+void hold_mutex(MUTEX *m, PCB *p) {
+	m->lock_with = p;
+	m->held_next = p->mutex.held;
+	p->mutex.held = m->h.index;
+}
+
+/*** Take a mutex away from its holder ***/
+// The mutex is removed from the list of mutexes held by the holder
+// and becomes free
+void drop_mutex(MUTEX *m) {
+	PCB *p = m->lock_with;
+	MUTEX *prev;
+
+	if (p == NULL) return;
+
+	if (p->mutex.held == m->h.index) p->mutex.held = m->held_next;
+	else {
+		prev = (MUTEX *)object_at(&mutexes, p->mutex.held);
+		while (prev->held_next != m->h.index)
+			prev = (MUTEX *)object_at(&mutexes, prev->held_next);
+		prev->held_next = m->held_next;
+	}
+	m->lock_with = NULL;
+}
+
+/*** Wait queue of a mutex ***/
+// NULL if there is no such mutex
+QUEUE *mutex_queue(mutex_t key) {
+	MUTEX *m = get_mutex(key);
+
+	if (m == NULL) return NULL;
+	return &m->waitq;
+}
+
+/*** Is process p holding the lock on mutex number <key>? ***/
+bool mutex_holder(mutex_t key, PCB *p) {
+	MUTEX *m = get_mutex(key);
+
+	return (m != NULL && m->lock_with == p);
+}
+
+/*** Process holding the lock on mutex number <key> ***/
+// NULL if the mutex is free or does not exist
+PCB *mutex_owner(mutex_t key) {
+	MUTEX *m = get_mutex(key);
+
+	if (m == NULL) return NULL;
+	return m->lock_with;
+}
+
+/*** Cleanup mutexes for a process ***/
+// Mutexes held by p are given to their next holders, as if p
+// unlocked them, and mutexes created by p are destroyed
+void free_mutex_locks(PCB *p) {
+	PCB *holder;
+	PCB *next_p;
+
+	// remove from wait queue, if any; holder may no longer need
+	// the priority it inherited from p
+	if (p->mutex.wait_on != 0) {
+		remove_queue_item(mutex_queue(p->mutex.wait_on), &p->mutex.wait_node);
+		holder = mutex_owner(p->mutex.wait_on);
+		p->mutex.wait_on = 0;
+		if (holder != NULL) update_priority(holder);
+	}
+
+	while (p->mutex.held != 0) {
+		next_p = release_mutex((MUTEX *)object_at(&mutexes, p->mutex.held));
+		if (next_p != NULL) update_priority(next_p); // inherits from remaining waiters
+	}
+
+	while (p->mutex.created != 0)
+		mutex_destroy(object_handle(object_at(&mutexes, p->mutex.created)), p);
+}
+
+/*** Raise priority of a mutex holder ***/
+// The raise is passed along if the holder is itself waiting on 
+// a mutex (chain of locks)
+void inherit_priority(PCB *holder, uint8_t priority) {
+	while (holder != NULL && holder->priority.effective < priority) {
+		holder->priority.effective = priority;
+
+		if (holder->mutex.wait_on == 0) break;
+		holder = mutex_owner(holder->mutex.wait_on);
+	}
+}
+
+/*** Recompute effective priority of a process ***/
+// Effective priority is the base priority, or the highest priority
+// of processes waiting on mutexes held by p, whichever is higher;
+// a change is passed along to the holder of the mutex p waits on
+// (a raise as by inherit_priority, a drop by recomputing its priority)
+// Only the mutexes held by p are visited
+void update_priority(PCB *p) {
+	uint32_t i;
+	MUTEX *m;
+	WAIT_NODE *waiter;
+	uint8_t priority = p->priority.base;
+	uint8_t old_priority = p->priority.effective;
+	PCB *holder;
+
+	for (i=p->mutex.held; i!=0; i=m->held_next) {
+		m = (MUTEX *)object_at(&mutexes, i);
+		waiter = highest_priority_waiter(&m->waitq);
+		if (waiter != NULL && waiter->p->priority.effective > priority)
+			priority = waiter->p->priority.effective;
+	}
+
+	p->priority.effective = priority;
+
+	if (p->mutex.wait_on != 0) {
+		holder = mutex_owner(p->mutex.wait_on);
+		if (priority > old_priority) inherit_priority(holder, priority);
+		else if (priority < old_priority && holder != NULL) update_priority(holder);
+	}
+}
+
+/*** Highest priority process waiting in a mutex queue ***/
+// Returns the wait node of the earliest queued one if more than one;
+// NULL if the queue is empty
+WAIT_NODE *highest_priority_waiter(QUEUE *q) {
+	WAIT_NODE *n;
+	WAIT_NODE *best = NULL;
+
+	for (n=q->head; n!=NULL; n=n->next) {
+		if (best == NULL || n->p->priority.effective > best->p->priority.effective)
+			best = n;
+	}
+
+	return best;
+}
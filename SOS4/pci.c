@@ -0,0 +1,53 @@
+////////////////////////////////////////////////////////
+// PCI configuration space
+// Configuration mechanism #1: the address of a 32-bit register
+// (bus, device, function, offset) is written to port 0xCF8 and the
+// register is then read/written at port 0xCFC
+
+#include "kernel_only.h"
+
+/*** Configuration address of a register ***/
+uint32_t pci_address(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset) {
+	return 0x80000000 | ((uint32_t)bus << 16) | ((uint32_t)(device & 0x1F) << 11) |
+	       ((uint32_t)(function & 0x07) << 8) | (offset & 0xFC);
+}
+
+/*** Read a configuration register ***/
+// <address> is from pci_address
+uint32_t pci_read(uint32_t address) {
+	port_write_long(0xCF8, address);
+	return port_read_long(0xCFC);
+}
+
+/*** Write a configuration register ***/
+void pci_write(uint32_t address, uint32_t value) {
+	port_write_long(0xCF8, address);
+	port_write_long(0xCFC, value);
+}
+
+/*** Find a device by its class ***/
+// Returns the configuration address (offset 0) of the first
+// function of class <class> and subclass <subclass>; 0 if none
+uint32_t pci_find_class(uint8_t class, uint8_t subclass) {
+	uint32_t bus, device, function, address;
+	uint32_t id, class_reg;
+
+	for (bus=0; bus<256; bus++) {
+		for (device=0; device<32; device++) {
+			for (function=0; function<8; function++) {
+				address = pci_address(bus, device, function, 0);
+				id = pci_read(address);
+				if ((id & 0xFFFF) == 0xFFFF) { // no such function
+					if (function == 0) break; // nor device
+					continue;
+				}
+				class_reg = pci_read(address + PCI_CLASS);
+				if ((class_reg >> 24) == class && ((class_reg >> 16) & 0xFF) == subclass)
+					return address;
+				// single function device?
+				if (function == 0 && !(pci_read(address + PCI_HEADER) & 0x00800000)) break;
+			}
+		}
+	}
+	return 0;
+}
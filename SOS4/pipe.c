@@ -0,0 +1,288 @@
+///////////////////////////////////////////////////////
+// Pipe implementation
+// This implementation provides PIPE_MAXNUMBER pipes; a pipe is
+// specified using an 8-bit number (called key)
+// A process has one read end (input) and one write end (output);
+// bytes written are kept in a kernel ring buffer of one page until
+// read. Whole, page aligned pages of a large write are not copied:
+// the frame is given to the pipe (writer keeps it copy-on-write) and
+// mapped into the reader if the reader's buffer is page aligned too
+// Queued pages always precede the bytes in the ring buffer: pages
+// are given only when the ring buffer is empty
+// Read and write block when nothing can be transferred; the blocked
+// process issues the system call again when woken up
+
+#include "kernel_only.h"
+
+PIPE pipes[PIPE_MAXNUMBER];	// the pipes; maximum 64 of them
+
+/*** Initialize all pipes ***/
+void init_pipes() {
+	int i;
+	for (i=0; i<PIPE_MAXNUMBER; i++) {
+		pipes[i].available = TRUE;
+		pipes[i].buffer = NULL;
+	}
+	pipes[0].available = FALSE;
+}
+
+/*** Create a pipe ***/
+// Returns 0 if no pipe object or memory is available; otherwise
+// the pipe number is returned. Nobody uses the pipe until it is
+// opened (pipe_open)
+pipe_t pipe_create() {
+	uint32_t i;
+
+	for (i=1; i<PIPE_MAXNUMBER; i++) {
+		if (pipes[i].available) {
+			pipes[i].buffer = (uint8_t *)alloc_kernel_pages(1);
+			if (pipes[i].buffer == NULL) return 0;
+
+			pipes[i].available = FALSE;
+			pipes[i].head = 0;
+			pipes[i].count = 0;
+			pipes[i].n_pages = 0;
+			pipes[i].page_offset = 0;
+			pipes[i].readers = 0;
+			pipes[i].writers = 0;
+			pipes[i].read_closed = FALSE;
+			pipes[i].write_closed = FALSE;
+			init_queue(&pipes[i].readq);
+			init_queue(&pipes[i].writeq);
+			return (pipe_t)i;
+		}
+	}
+	return 0;
+}
+
+/*** Open one end of a pipe for process p ***/
+// mode is PIPE_READ_END or PIPE_WRITE_END; an end already open
+// in p is closed first. Returns FALSE if the pipe does not exist
+bool pipe_open(pipe_t key, uint32_t mode, PCB *p) {
+	if (key == 0 || key >= PIPE_MAXNUMBER || pipes[key].available) return FALSE;
+
+	if (mode == PIPE_READ_END) {
+		if (p->pipe.in != 0) pipe_close(p->pipe.in, PIPE_READ_END);
+		pipes[key].readers++;
+		p->pipe.in = key;
+	}
+	else {
+		if (p->pipe.out != 0) pipe_close(p->pipe.out, PIPE_WRITE_END);
+		pipes[key].writers++;
+		p->pipe.out = key;
+	}
+	return TRUE;
+}
+
+/*** Close one end of a pipe ***/
+// When the last reader (writer) goes away, writers (readers) are
+// woken up to see it; the pipe is freed once both ends are closed
+// Can also be called on an end nobody has opened, to mark it closed
+void pipe_close(pipe_t key, uint32_t mode) {
+	PIPE *pp = &pipes[key];
+
+	if (mode == PIPE_READ_END) {
+		if (pp->readers > 0) pp->readers--;
+		if (pp->readers == 0) {
+			pp->read_closed = TRUE;
+			wake_pipe_queue(&pp->writeq);
+		}
+	}
+	else {
+		if (pp->writers > 0) pp->writers--;
+		if (pp->writers == 0) {
+			pp->write_closed = TRUE;
+			wake_pipe_queue(&pp->readq);
+		}
+	}
+
+	if (pp->readers == 0 && pp->writers == 0 && pp->read_closed && pp->write_closed) {
+		for (; pp->n_pages > 0; pp->n_pages--)
+			dealloc_frames((void *)pp->page[pp->n_pages-1], 1);
+		dealloc_frames((void *)((uint32_t)pp->buffer - KERNEL_BASE), 1);
+		pp->buffer = NULL;
+		pp->available = TRUE;
+	}
+}
+
+/*** Read from the input pipe of process p ***/
+// Reads at most n bytes to logical address <buf> (current address
+// space); *n_read is the number of bytes read, 0 at end of input.
+// Returns FALSE if nothing can be read yet (p is queued)
+bool pipe_read(PCB *p, uint8_t *buf, uint32_t n, uint32_t *n_read) {
+	PIPE *pp = &pipes[p->pipe.in];
+	uint32_t done = 0;
+	uint32_t i, len;
+	uint8_t *page;
+
+	*n_read = 0;
+	if (p->pipe.in == 0 || n == 0) return TRUE;
+
+	// given pages first
+	while (done < n && pp->n_pages > 0) {
+		if (pp->page_offset == 0 && n - done >= 4096 && ((uint32_t)(buf+done) & 0xFFF) == 0 &&
+		    receive_page(p, (uint32_t)(buf+done), pp->page[0])) {
+			done += 4096; // frame (and the pipe's reference) now belongs to p
+		}
+		else {
+			len = 4096 - pp->page_offset;
+			if (len > n - done) len = n - done;
+
+			page = (uint8_t *)map_frame(pp->page[0]);
+			for (i=0; i<len; i++) buf[done+i] = page[pp->page_offset+i];
+
+			done += len;
+			pp->page_offset += len;
+			if (pp->page_offset < 4096) break;
+
+			dealloc_frames((void *)pp->page[0], 1);
+		}
+
+		pp->page_offset = 0;
+		for (i=1; i<pp->n_pages; i++) pp->page[i-1] = pp->page[i];
+		pp->n_pages--;
+	}
+
+	// then the ring buffer
+	while (done < n && pp->count > 0) {
+		buf[done++] = pp->buffer[pp->head];
+		pp->head = (pp->head + 1) % PIPE_BUFFER_SIZE;
+		pp->count--;
+	}
+
+	if (done == 0) {
+		if (pp->writers == 0 && pp->write_closed) return TRUE; // end of input
+
+		enqueue(&pp->readq, &p->pipe.wait_node);
+		p->pipe.wait_queue = &pp->readq;
+		return FALSE;
+	}
+
+	wake_pipe_queue(&pp->writeq); // there is space now
+	*n_read = done;
+	return TRUE;
+}
+
+/*** Write to the output pipe of process p ***/
+// Writes at most n bytes from logical address <buf> (current address
+// space); *n_written is the number of bytes written, 0 if nobody will
+// read them. Returns FALSE if nothing can be written yet (p is queued)
+bool pipe_write(PCB *p, uint8_t *buf, uint32_t n, uint32_t *n_written) {
+	PIPE *pp = &pipes[p->pipe.out];
+	uint32_t done = 0;
+	uint32_t frame;
+
+	*n_written = 0;
+	if (p->pipe.out == 0 || n == 0) return TRUE;
+	if (pp->readers == 0 && pp->read_closed) return TRUE; // broken pipe
+
+	// whole pages are given, not copied
+	while (n - done >= 4096 && ((uint32_t)(buf+done) & 0xFFF) == 0 &&
+	       pp->count == 0 && pp->n_pages < PIPE_MAXPAGES) {
+		frame = give_page(p, (uint32_t)(buf+done));
+		if (frame == 0) break;
+
+		pp->page[pp->n_pages++] = frame;
+		done += 4096;
+	}
+
+	// rest is copied to the ring buffer
+	while (done < n && pp->count < PIPE_BUFFER_SIZE) {
+		pp->buffer[(pp->head + pp->count) % PIPE_BUFFER_SIZE] = buf[done++];
+		pp->count++;
+	}
+
+	if (done == 0) {
+		enqueue(&pp->writeq, &p->pipe.wait_node);
+		p->pipe.wait_queue = &pp->writeq;
+		return FALSE;
+	}
+
+	wake_pipe_queue(&pp->readq); // there is data now
+	*n_written = done;
+	return TRUE;
+}
+
+/*** Give the frame of a page to a pipe ***/
+// The page at logical address <page> of process p stays mapped
+// copy-on-write; returns the frame address, or 0 if the page cannot
+// be given (not mapped, or shared memory)
+uint32_t give_page(PCB *p, uint32_t page) {
+	PTE *pte = get_pte(p, page);
+	uint32_t frame;
+
+	if (pte == NULL || (uint32_t)(*pte & PTE_PRESENT) == 0 ||
+	    (uint32_t)(*pte & PTE_USER_SUPERVISOR) == 0) return 0;
+
+	frame = *pte & 0xFFFFF000;
+	if (get_frame_type((void *)frame) != FRAME_USER &&
+	    get_frame_type((void *)frame) != FRAME_IMAGE) return 0;
+
+	if (*pte & PTE_READ_WRITE) {
+		*pte = frame | PTE_COPY_ON_WRITE | PTE_PRESENT | PTE_USER_SUPERVISOR;
+		invalidate_page(page);
+	}
+	ref_frames((void *)frame, 1); // reference held by the pipe
+	return frame;
+}
+
+/*** Map a frame from a pipe into a reader ***/
+// The frame replaces the writable page at logical address <page> of
+// process p, copy-on-write; the pipe's reference goes with it.
+// Returns FALSE if there is no such page
+bool receive_page(PCB *p, uint32_t page, uint32_t frame) {
+	PTE *pte = get_pte(p, page);
+
+	if (pte == NULL || (uint32_t)(*pte & PTE_PRESENT) == 0 ||
+	    (uint32_t)(*pte & PTE_USER_SUPERVISOR) == 0 ||
+	    (uint32_t)(*pte & (PTE_READ_WRITE | PTE_COPY_ON_WRITE)) == 0) return FALSE;
+	if (get_frame_type((void *)(*pte & 0xFFFFF000)) == FRAME_SHMEM) return FALSE;
+
+	dealloc_frames((void *)(*pte & 0xFFFFF000), 1);
+	*pte = frame | PTE_COPY_ON_WRITE | PTE_PRESENT | PTE_USER_SUPERVISOR;
+	invalidate_page(page);
+	return TRUE;
+}
+
+/*** Wake up all processes in a pipe wait queue ***/
+void wake_pipe_queue(QUEUE *q) {
+	WAIT_NODE *n;
+
+	while ((n = q->head) != NULL) {
+		remove_queue_item(q, n);
+		if (n->index != WAIT_SINGLE) wait_any_fired(n); // in wait.c
+		else {
+			n->p->pipe.wait_queue = NULL;
+			n->p->state = READY;
+		}
+	}
+}
+
+/*** Can the input pipe of process p be read without waiting? ***/
+// TRUE also at end of input
+bool pipe_readable(PCB *p) {
+	PIPE *pp = &pipes[p->pipe.in];
+
+	if (p->pipe.in == 0) return FALSE;
+	return (pp->count > 0 || pp->n_pages > 0 || (pp->writers == 0 && pp->write_closed));
+}
+
+/*** Queue of processes waiting to read the input pipe of process p ***/
+// NULL if p has no input pipe
+QUEUE *pipe_read_queue(PCB *p) {
+	if (p->pipe.in == 0) return NULL;
+	return &pipes[p->pipe.in].readq;
+}
+
+/*** Cleanup pipes for a process ***/
+void free_pipes(PCB *p) {
+	if (p->pipe.wait_queue != NULL) {
+		remove_queue_item(p->pipe.wait_queue, &p->pipe.wait_node);
+		p->pipe.wait_queue = NULL;
+	}
+
+	if (p->pipe.in != 0) pipe_close(p->pipe.in, PIPE_READ_END);
+	if (p->pipe.out != 0) pipe_close(p->pipe.out, PIPE_WRITE_END);
+	p->pipe.in = 0;
+	p->pipe.out = 0;
+}
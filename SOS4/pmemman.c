@@ -16,6 +16,14 @@ extern uint64_t total_memory;
 
 uint32_t total_frames; // max 16384 (*4KB = 64MB)
 
+// Every frame also has a descriptor (see FRAME) telling how many
+// references (mappings) there are to the frame and what it is used
+// for; a frame is freed only when its last reference is dropped
+// 64MB of memory requires 128KB of descriptors, allocated from
+// kernel memory
+FRAME *frame_table;
+uint32_t frame_count[FRAME_TYPES]; // number of frames of each type
+
 
 /*** Initialize physical memory manager ***/
 void init_physical_memory_manager(void) {
@@ -30,6 +38,42 @@ void init_physical_memory_manager(void) {
 	for (i=0; i<32; i++) mem_bitmap[i]=0; // 32*8*4KB = 1MB
 	mem_bitmap[32] = 0x1F; // frames 256, 257 and 258 occupied (see lmemman.c)
 
+	// frame descriptors; frames in use so far belong to the kernel
+	uint32_t n_table_frames = bytes_to_frames(total_frames*sizeof(FRAME));
+	uint32_t table_frame = find_frames(n_table_frames,264,1023);
+	modify_bitmap(table_frame,n_table_frames,0);
+	frame_table = (FRAME *)(table_frame*4096 + KERNEL_BASE);
+
+	for (i=0; i<FRAME_TYPES; i++) frame_count[i] = 0;
+	for (i=0; i<total_frames; i++) {
+		frame_table[i].lru_prev = 0;
+		frame_table[i].lru_next = 0;
+		frame_table[i].flags = 0;
+		if ((mem_bitmap[i/8] << (i%8)) & 0x80) { // available
+			frame_table[i].refs = 0;
+			frame_table[i].type = FRAME_FREE;
+		}
+		else {
+			frame_table[i].refs = 1;
+			frame_table[i].type = FRAME_KERNEL;
+		}
+		frame_count[frame_table[i].type]++;
+	}
+}
+
+/*** Mark frames as allocated ***/
+// Each frame gets one reference and the given type
+void claim_frames(uint32_t start_frame, uint32_t n_frames, uint8_t type) {
+	uint32_t i;
+
+	modify_bitmap(start_frame,n_frames,0);
+
+	for (i=start_frame; i<start_frame+n_frames; i++) {
+		frame_count[frame_table[i].type]--;
+		frame_table[i].refs = 1;
+		frame_table[i].type = type;
+		frame_count[type]++;
+	}
 }
 
 /*** Allocate frames from user memory***/
@@ -53,8 +97,8 @@ void *alloc_frames(uint32_t n_frames, bool mode) {
 
 	if (start_frame != 0) {
 		alloc_base = (uint32_t *)(start_frame*4096);
-		// update memory bitmap
-		modify_bitmap(start_frame,n_frames,0);
+		// update memory bitmap and frame descriptors
+		claim_frames(start_frame,n_frames,(mode==KERNEL_ALLOC?FRAME_KERNEL:FRAME_USER));
 	}
 	
 	return (void *)alloc_base;
@@ -72,6 +116,8 @@ uint32_t find_frames(uint32_t n_frames, uint32_t from, uint32_t to) {
 	while (i < k) {
 
 		if (mem_bitmap[i] == 0) { // all zeros mean none available here
+			found_frames = 0;
+			start_frame = 0;
 			i++;
 			continue;
 		}
@@ -95,6 +141,104 @@ uint32_t find_frames(uint32_t n_frames, uint32_t from, uint32_t to) {
 	return 0;
 }
 
+/*** Finds the longest run of free contiguous memory ***/
+// Looks for up to max_frames frames; returns frame number of the
+// run (0 if no frame is free) and its length in *n_found
+uint32_t find_longest_run(uint32_t max_frames, uint32_t from, uint32_t to, uint32_t *n_found) {
+	uint32_t best_frame = 0, best_length = 0;
+	uint32_t start_frame = 0;
+	uint32_t found_frames = 0;
+	uint32_t i=from/8, j, k=to/8;
+
+	*n_found = 0;
+	if (max_frames == 0) return 0;
+
+	while (i < k) {
+		for (j=0; j<8; j++) {
+			if ((mem_bitmap[i] << j) & 0x80) {
+				found_frames++;
+				if (start_frame==0) start_frame = i*8 + j;
+			}
+			else { // start looking again
+				found_frames = 0;
+				start_frame = 0;
+			}
+
+			if (found_frames > best_length) {
+				best_frame = start_frame;
+				best_length = found_frames;
+				if (best_length == max_frames) {
+					*n_found = best_length;
+					return best_frame;
+				}
+			}
+		}
+		i++;
+	}
+
+	*n_found = best_length;
+	return best_frame;
+}
+
+/*** Allocate a run of contiguous frames from user memory ***/
+// Allocates the longest run of free frames up to n_frames long
+// Returns NULL if no frame is free; otherwise first frame address
+// (run length in *n_alloc)
+void *alloc_frame_run(uint32_t n_frames, uint32_t *n_alloc) {
+	uint32_t start_frame = find_longest_run(n_frames,1024,total_frames,n_alloc);
+
+	if (start_frame == 0) return NULL;
+
+	claim_frames(start_frame,*n_alloc,FRAME_USER);
+	return (void *)(start_frame*4096);
+}
+
+/*** Allocate frames from user memory, not necessarily contiguous ***/
+// Fills frames[] with the addresses of n_frames frames; frames are
+// taken in runs that are as long as possible, so fragmentation of
+// physical memory does not matter
+// Returns FALSE (and allocates nothing) if not enough frames are free
+bool alloc_frames_scattered(uint32_t n_frames, uint32_t *frames) {
+	uint32_t run_base;
+	uint32_t run_length;
+	uint32_t i = 0;
+
+	if (count_free_frames(1024,total_frames) < n_frames) return FALSE;
+
+	while (i < n_frames) {
+		run_base = (uint32_t)alloc_frame_run(n_frames-i,&run_length);
+		if (run_base == NULL) { // cannot happen after the count above
+			dealloc_frames_scattered(frames,i);
+			return FALSE;
+		}
+
+		for (; run_length>0; run_length--,run_base+=4096)
+			frames[i++] = run_base;
+	}
+
+	return TRUE;
+}
+
+/*** Deallocate frames listed in frames[] ***/
+// Drops one reference to each frame; runs of contiguous frames
+// are returned together
+void dealloc_frames_scattered(uint32_t *frames, uint32_t n_frames) {
+	uint32_t i;
+	uint32_t run_base = 0;
+	uint32_t run_length = 0;
+
+	for (i=0; i<n_frames; i++) {
+		if (run_length != 0 && frames[i] == run_base + run_length*4096) 
+			run_length++;
+		else {
+			if (run_length != 0) dealloc_frames((void *)run_base, run_length);
+			run_base = frames[i];
+			run_length = 1;
+		}
+	}
+	if (run_length != 0) dealloc_frames((void *)run_base, run_length);
+}
+
 /*** Set/Unset memory bitmap ***/
 // Sets/unsets the memory bitmap, starting at start_frame and continues
 // for n_frames
@@ -106,6 +250,13 @@ void modify_bitmap(uint32_t start_frame, uint32_t n_frames, bool set) {
 
 	// update memory bitmap
 	while (n_frames > 0) {
+		if (j==0 && n_frames>=8) { // 8 frames at a time when byte aligned
+			mem_bitmap[i] = (set?0xFF:0x00);
+			n_frames -= 8;
+			i++;
+			continue;
+		}
+
 		if (set) 
 			mem_bitmap[i] |= ((uint32_t)1 << (8-j-1)); //make jth bit one
 		else
@@ -121,13 +272,69 @@ void modify_bitmap(uint32_t start_frame, uint32_t n_frames, bool set) {
 }
 
 /*** Deallocate memory ***/
-// Deallocate n_frames frames; first frame is the one
-// corrsponding to physical address <loc>
+// Drops one reference to each of n_frames frames; first frame is the 
+// one corrsponding to physical address <loc>; frames with no more
+// references are freed
 void dealloc_frames(void *loc, uint32_t n_frames) {
-	uint32_t start_frame = ((uint32_t)loc)/4096; // address to frame number
-	modify_bitmap(start_frame, n_frames, 1);
+	uint32_t frame = ((uint32_t)loc)/4096; // address to frame number
+	uint32_t run_start = 0;	// run of contiguous frames being freed
+	uint32_t run_length = 0;
+
+	for (; n_frames>0; n_frames--, frame++) {
+		if (frame_table[frame].refs > 0) frame_table[frame].refs--;
+
+		if (frame_table[frame].refs == 0 && frame_table[frame].type != FRAME_FREE) {
+			frame_count[frame_table[frame].type]--;
+			frame_table[frame].type = FRAME_FREE;
+			frame_count[FRAME_FREE]++;
+
+			if (run_length == 0) run_start = frame;
+			run_length++;
+		}
+		else if (run_length != 0) { // frame still in use; free the run so far
+			modify_bitmap(run_start, run_length, 1);
+			run_length = 0;
+		}
+	}
+
+	if (run_length != 0) modify_bitmap(run_start, run_length, 1);
+}
+
+/*** Add a reference to frames ***/
+// Called when n_frames frames starting at physical address <loc>
+// are mapped one more time (shared)
+void ref_frames(void *loc, uint32_t n_frames) {
+	uint32_t frame = ((uint32_t)loc)/4096;
+
+	for (; n_frames>0; n_frames--, frame++) 
+		frame_table[frame].refs++;
+}
+
+/*** Number of references to a frame ***/
+uint32_t get_frame_refs(void *loc) {
+	return frame_table[((uint32_t)loc)/4096].refs;
+}
+
+/*** Type of a frame ***/
+uint8_t get_frame_type(void *loc) {
+	return frame_table[((uint32_t)loc)/4096].type;
+}
+
+/*** Change the type of allocated frames ***/
+void set_frame_type(void *loc, uint32_t n_frames, uint8_t type) {
+	uint32_t frame = ((uint32_t)loc)/4096;
+
+	for (; n_frames>0; n_frames--, frame++) {
+		frame_count[frame_table[frame].type]--;
+		frame_table[frame].type = type;
+		frame_count[type]++;
+	}
 }
 
+/*** Number of frames used as given type ***/
+uint32_t count_frames(uint8_t type) {
+	return frame_count[type];
+}
 
 /*** Number of frames required for given bytes ***/
 uint32_t bytes_to_frames(uint32_t count) {
@@ -137,6 +344,21 @@ uint32_t bytes_to_frames(uint32_t count) {
 	return n_frames;
 }
 
+/*** Return number of free frames between two frame numbers ***/
+uint32_t count_free_frames(uint32_t from, uint32_t to) {
+	uint32_t i;
+	uint32_t total = 0;
+
+	for (i=from; i<to; i++) {
+		if (i%8==0 && i+8<=to) { // whole bitmap byte at a time
+			if (mem_bitmap[i/8] == 0xFF) { total += 8; i += 7; continue; }
+			if (mem_bitmap[i/8] == 0) { i += 7; continue; }
+		}
+		if ((mem_bitmap[i/8] << (i%8)) & 0x80) total++;
+	}
+	return total;
+}
+
 /*** Return number of bytes free ***/
 uint32_t count_free_memory() {
 	int i,j;
@@ -1,79 +1,68 @@
 ////////////////////////////////////////////////////////
-// A queue (of process PCB addresses) implementation
-// A queue will be made up of an array of PCB addresses;
-// memory for this array is allocatd on first use of the
-// queue; there will be exactly 1 page for this array, so
-// Q_MAXSIZE should be decided accordingly, i.e. <=1024
+// A wait queue (of processes) implementation
+// The queue is a doubly linked list of wait nodes; the
+// nodes are embedded in the PCB of the waiting process
+// (see PCB), so a queue needs no memory of its own and
+// has no size limit; adding, removing the head, and
+// removing an arbitrary node are all O(1)
 
 #include "kernel_only.h"
 
-extern PDE *k_page_directory;
-
 /*** Initialize a queue ***/
 void init_queue(QUEUE *q) {
-	q->data = NULL; // array not allocated yet
-	q->head = 0;
+	q->head = NULL;
+	q->tail = NULL;
 	q->count = 0;
 }
 
 /*** Add to end of queue ***/
-// Returns the index in the queue array where item is added.
-// TODO: what if queue is full or not enough memory for data
-uint32_t enqueue(QUEUE *q, PCB *p) {
-	uint32_t loc;
+// Node n must not already be in a queue; the time it is queued is
+// noted in the node (for lock statistics)
+void enqueue(QUEUE *q, WAIT_NODE *n) {
+	n->since = get_epochs();
+	n->next = NULL;
+	n->prev = q->tail;
 
-	// we will allocate space for items in queue on first use
-	if (q->data == NULL) { 
-		// allocate memory to hold queue data
-		q->data = (uint32_t *)alloc_kernel_pages(1);
-	}
+	if (q->tail == NULL) q->head = n; // empty queue
+	else q->tail->next = n;
+	q->tail = n;
 
-	loc = (q->head + q->count) % Q_MAXSIZE;
-	q->data[loc] = (uint32_t)p;
 	q->count++;
-	return loc;
 }
 
 /*** Remove from head of queue ***/
-// Returns NULL if queue is empty
+// Returns the PCB of the waiting process; NULL if queue is empty
 PCB *dequeue(QUEUE *q) {
-	PCB *ret;
+	WAIT_NODE *n = q->head;
 
-	do {
-		if (q->count == 0) return NULL;
+	if (n == NULL) return NULL;
 
-		ret = (PCB *)q->data[q->head];
-		q->count--;
-		q->head = (q->head + 1) % Q_MAXSIZE;
-
-	} while (ret == (PCB *)Q_ITEM_REMOVED);
-	
-	return ret;
+	remove_queue_item(q, n);
+	return n->p;
 }
 
-/*** Replace item in queue ***/
-// Stores Q_ITEM_REMOVED to mark item as removed.
-void remove_queue_item(QUEUE *q, uint32_t loc) {
-	if (q->data != NULL) {
-		q->data[loc] = (uint32_t)Q_ITEM_REMOVED;
-	}
-}
+/*** Remove node from queue ***/
+// Node n must be in queue q
+void remove_queue_item(QUEUE *q, WAIT_NODE *n) {
+	if (n->prev == NULL) q->head = n->next;
+	else n->prev->next = n->next;
 
-/*** Return page allocated for queue ***/
-// Do not call free_queue without calling init_queue
-void free_queue(QUEUE *q) {
-	if (q->data != NULL) { 
-		dealloc_page((void *)q->data, k_page_directory);
-	}
+	if (n->next == NULL) q->tail = n->prev;
+	else n->next->prev = n->prev;
+
+	n->prev = NULL;
+	n->next = NULL;
+	q->count--;
 }
 
 /*** Print queue ***/
 // Print queue from head to tail
 void print_queue(QUEUE *q) {
-	int i;
+	int i = 0;
+	WAIT_NODE *n;
 
 	sys_printf("Index\tPCB\n\n");
-	for (i=0; i<q->count; i++) {
-		sys_printf("%d\t%x\n",i,q->data[(q->head + i) % Q_MAXSIZE]);
+	for (n=q->head; n!=NULL; n=n->next) {
+		sys_printf("%d\t%x\n",i++,(uint32_t)n->p);
 	}
 }
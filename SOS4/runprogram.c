@@ -15,47 +15,108 @@ uint32_t next_pid = 0;
 // starting from sector LBA in disk and adds PCB to ready queue; 
 // control returns to console, a.k.a. multi-tasking system;
 // programs run as background processes (blocks forever if getc is used)
+// pipe_in and pipe_out are the pipes the process reads from and writes 
+// to (0 if none); returns FALSE if the process could not be created
+bool run(uint32_t LBA, uint32_t n_sectors, pipe_t pipe_in, pipe_t pipe_out) {
+	PCB *user_program;
+	IMAGE *image;
+	uint32_t eflags;
+
+	// processes that terminated since the command started (copies,
+	// pipelines) give back their memory first
+	reclaim_all_processes(); // in scheduler.c
+
+	// PCB is kept in kernel memory
+	user_program = (PCB *)alloc_kernel_pages(1);
+	if (user_program == NULL) {
+		puts("run: Not enough kernel memory.\n");
+		return FALSE;
+	}
 
-/** DO NOT UNCOMMENT THE FOLLOWING ***/
-/*
-void run(uint32_t LBA, uint32_t n_sectors) {
-	// you implemented this in a previous assignment
-	...
+	// program image is shared with other processes running the same program
+	image = get_image(LBA, n_sectors); // in image.c
+	if (image == NULL) {
+		dealloc_page((void *)user_program, k_page_directory);
+		puts("run: Not enough memory.\n");
+		return FALSE;
+	}
 
-	user_program->mutex.wait_on = -1; // not waiting on any mutex
-	user_program->semaphore.wait_on = -1; // not waiting on any semaphore
-	user_program->shared_memory.created = FALSE; // no shared memory objects yet
+	// allocate memory and set up page tables for the program
+	if (!init_logical_memory(user_program, image)) {
+		release_image(image);
+		dealloc_page((void *)user_program, k_page_directory);
+		puts("run: Not enough memory.\n");
+		return FALSE;
+	}
+
+	user_program->pid = next_pid++;
+
+	// user processes run in Ring 3 (RPL=3 for selectors)
+	user_program->cpu.ss = 0x23; // user data segment
+	user_program->cpu.esp = user_program->mem.start_stack;
+	user_program->cpu.ebp = user_program->mem.start_stack;
+	user_program->cpu.cs = 0x1B; // user code segment
+	user_program->cpu.eip = user_program->mem.start_code;
+	asm volatile ("pushfl\n"
+		      "popl %0\n": "=r"(eflags));
+	user_program->cpu.eflags = eflags;
+
+	user_program->state = NEW; // program will be loaded when first scheduled
+	user_program->sleep_end = 0;
+	user_program->priority.base = PRIORITY_DEFAULT;
+	user_program->priority.effective = PRIORITY_DEFAULT;
+
+	user_program->disk.LBA = LBA;
+	user_program->disk.n_sectors = n_sectors;
+	user_program->disk.wait_node.p = user_program;
+	user_program->disk.wait_node.index = WAIT_SINGLE;
+
+	user_program->mutex.wait_on = 0; // not waiting on any mutex
+	user_program->mutex.created = 0; // no mutexes created yet
+	user_program->mutex.held = 0; // no mutexes held yet
+	user_program->mutex.wait_node.p = user_program;
+	user_program->mutex.wait_node.index = WAIT_SINGLE;
+	user_program->semaphore.wait_on = 0; // not waiting on any semaphore
+	user_program->semaphore.created = 0; // no semaphores created yet
+	user_program->semaphore.wait_node.p = user_program;
+	user_program->semaphore.wait_node.index = WAIT_SINGLE;
+	user_program->barrier.wait_on = 0; // not waiting at any barrier
+	user_program->barrier.created = 0; // no barriers created yet
+	user_program->barrier.wait_node.p = user_program;
+	user_program->barrier.wait_node.index = WAIT_SINGLE;
+	user_program->cond.wait_on = 0; // not waiting on any condition variable
+	user_program->cond.created = 0; // no condition variables created yet
+	user_program->cond.wait_node.p = user_program;
+	user_program->cond.wait_node.index = WAIT_SINGLE;
+	user_program->rwlock.wait_on = 0; // not waiting on any reader-writer lock
+	user_program->rwlock.created = 0; // no reader-writer locks created yet
+	user_program->rwlock.written = 0; // no locks held yet
+	user_program->rwlock.reading = 0;
+	user_program->rwlock.wait_node.p = user_program;
+	user_program->rwlock.wait_node.index = WAIT_SINGLE;
+	user_program->futex.wait_on = 0; // not waiting on any futex
+	user_program->futex.wait_node.p = user_program;
+	user_program->futex.wait_node.index = WAIT_SINGLE;
+	user_program->shared_memory.n = 0; // no shared memory areas yet
+
+	user_program->pipe.in = 0;
+	user_program->pipe.out = 0;
+	user_program->pipe.wait_queue = NULL;
+	user_program->pipe.wait_node.p = user_program;
+	user_program->pipe.wait_node.index = WAIT_SINGLE;
+	user_program->wait_any.n = 0; // not waiting on a set of objects
+	user_program->ipc.state = IPC_NONE;
+	init_queue(&user_program->ipc.senders);
+	user_program->ipc.wait_node.p = user_program;
+	user_program->ipc.wait_node.index = WAIT_SINGLE;
+	disable_interrupts(); // running processes may be using the pipes
+	if (pipe_in != 0) pipe_open(pipe_in, PIPE_READ_END, user_program);
+	if (pipe_out != 0) pipe_open(pipe_out, PIPE_WRITE_END, user_program);
+	enable_interrupts();
 
 	// add PCB to process queue and then return; process will start running when scheduled
 	add_to_processq(user_program); // in scheduler.c
-
-}
-*/
-
-/*** Load the user program to memory ***/
-bool load_disk_to_memory(uint32_t LBA, uint32_t n_sectors, uint8_t *mem) {
-	uint8_t status;
-	uint16_t read_count = 0;
-
-	// read up to 256 sectors at a time
-	for (;n_sectors>0;) {
-		read_count = (n_sectors>=256?256:n_sectors);
-
-		status = read_disk(LBA,(read_count==256?0:read_count),mem);
-		
-		if (status == DISK_ERROR_LBA_OUTSIDE_RANGE
-			|| status == DISK_ERROR_SECTORCOUNT_TOO_BIG) 
-			return FALSE;
-
-		else if (status == DISK_ERROR || status == DISK_ERROR_ERR
-				|| status == DISK_ERROR_DF) 
-			return FALSE;
-
-		n_sectors -= read_count;
-		LBA += read_count;
-		mem += 512*read_count;
-	}
-
 	return TRUE;
+
 }
 
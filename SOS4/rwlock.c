@@ -0,0 +1,233 @@
+///////////////////////////////////////////////////////
+// Reader-writer lock implementation
+// This implementation provides reader-writer locks for use by user
+// processes; a lock is specified using a 32-bit handle (called key)
+// from the reader-writer lock handle table (see handle.c), which
+// grows as more locks are created
+// Any number of readers can hold the lock together; a writer holds
+// it alone. Waiting processes are served in FIFO order, and a reader
+// does not get the lock while a writer is waiting, so writers are
+// not starved by a stream of readers
+// Every process keeps a list of the locks it holds for writing and
+// of its read holds (READ_HOLD, one per lock, in a handle table of
+// their own), so that only holders can release a lock and the locks
+// of a process that dies are released
+// Using a lock that has not been created (or has been destroyed) is
+// harmless; the functions always return in such cases
+
+#include "kernel_only.h"
+
+HANDLE_TABLE rwlocks;		// the reader-writer locks
+HANDLE_TABLE read_holds;	// locks held for reading, listed by holder
+
+/*** Initialize reader-writer lock tables ***/
+void init_rwlocks() {
+	init_handle_table(&rwlocks, sizeof(RWLOCK));
+	init_handle_table(&read_holds, sizeof(READ_HOLD));
+}
+
+/*** Reader-writer lock with a given key ***/
+// Returns NULL if there is no such lock
+RWLOCK *get_rwlock(rwlock_t key) {
+	return (RWLOCK *)get_object(&rwlocks, key);
+}
+
+/*** Create a reader-writer lock ***/
+// The function returns 0 if no memory is available for a new
+// lock; otherwise the key of the lock is returned
+rwlock_t rwlock_create(PCB *p) {
+	RWLOCK *l = (RWLOCK *)alloc_object(&rwlocks, p, &p->rwlock.created);
+
+	if (l == NULL) return 0;
+
+	l->readers = 0;
+	l->writer = NULL;
+	init_queue(&l->waitq);
+	return object_handle(&l->h);
+}
+
+/*** Destroy a reader-writer lock with a given key ***/
+// This should be called by the process who created the lock; lock
+// is automatically destroyed if creator process dies. Processes
+// still waiting on it are woken up without the lock; read holds of
+// the lock are dropped later (see find_read_hold)
+void rwlock_destroy(rwlock_t key, PCB *p) {
+	RWLOCK *l = get_rwlock(key);
+	PCB *q;
+
+	if (l == NULL || l->h.creator != p->pid) return;
+
+	while ((q = dequeue(&l->waitq)) != NULL) {
+		q->rwlock.wait_on = 0;
+		q->cpu.edx = FALSE; // return value
+		q->state = READY;
+	}
+	drop_write(l);
+	free_object(&rwlocks, &l->h, &p->rwlock.created);
+}
+
+/*** Obtain lock for reading or writing ***/
+// Returns TRUE if process p does not wait; otherwise the process is
+// queued and FALSE is returned. The return value of the system call
+// is set here: TRUE if p gets the lock (now or when woken up), FALSE
+// if there is no such lock or no memory to record a read hold
+bool rwlock_lock(rwlock_t key, bool write, PCB *p) {
+	RWLOCK *l = get_rwlock(key);
+	READ_HOLD *r = NULL;
+
+	p->cpu.edx = FALSE; // return value
+	if (l == NULL) return TRUE; // do not wait on a lock that does not exist
+
+	// a reader records its hold before waiting, so that the lock can
+	// always be given to it
+	if (!write) {
+		r = find_read_hold(p, key);
+		if (r == NULL) {
+			r = (READ_HOLD *)alloc_object(&read_holds, p, &p->rwlock.reading);
+			if (r == NULL) return TRUE;
+			r->lock = key;
+			r->count = 0;
+		}
+	}
+
+	p->cpu.edx = TRUE; // return value
+	if (l->writer == NULL && l->waitq.count == 0 && (!write || l->readers == 0)) {
+		if (write) hold_write(l, p);
+		else {
+			l->readers++;
+			r->count++;
+		}
+		return TRUE;
+	}
+
+	enqueue(&l->waitq, &p->rwlock.wait_node);
+	p->rwlock.wait_on = key;
+	p->rwlock.write = write;
+	return FALSE;
+}
+
+/*** Release a previously obtained lock ***/
+// Returns FALSE if p holds the lock neither for writing nor for
+// reading
+bool rwlock_unlock(rwlock_t key, PCB *p) {
+	RWLOCK *l = get_rwlock(key);
+	READ_HOLD *r;
+
+	if (l == NULL) return FALSE;
+
+	if (l->writer == p) drop_write(l);
+	else {
+		r = find_read_hold(p, key);
+		if (r == NULL || r->count == 0) return FALSE;
+
+		l->readers--;
+		r->count--;
+		if (r->count == 0) free_object(&read_holds, &r->h, &p->rwlock.reading);
+	}
+
+	grant_rwlock(l);
+	return TRUE;
+}
+
+/*** Give lock to waiting processes ***/
+// If there is no writer, the lock is given to the waiting writer at
+// the head of the queue (once there are no readers), or to all
+// readers at the head of the queue
+void grant_rwlock(RWLOCK *l) {
+	PCB *next_p;
+
+	while (l->writer == NULL && l->waitq.head != NULL) {
+		next_p = l->waitq.head->p;
+		if (next_p->rwlock.write && l->readers > 0) break; // writer waits for readers
+
+		dequeue(&l->waitq);
+		next_p->rwlock.wait_on = 0;
+		next_p->state = READY;
+		if (next_p->rwlock.write) hold_write(l, next_p);
+		else {
+			l->readers++;
+			find_read_hold(next_p, object_handle(&l->h))->count++; // recorded by rwlock_lock
+		}
+	}
+}
+
+/*** Make process p the writer of a lock ***/
+// The lock is added to the list of locks p holds for writing
+void hold_write(RWLOCK *l, PCB *p) {
+	l->writer = p;
+	l->written_next = p->rwlock.written;
+	p->rwlock.written = l->h.index;
+}
+
+/*** Take a lock away from its writer ***/
+// The lock is removed from the list of locks held for writing by
+// the writer; nothing happens if there is no writer
+void drop_write(RWLOCK *l) {
+	PCB *p = l->writer;
+	RWLOCK *prev;
+
+	if (p == NULL) return;
+
+	if (p->rwlock.written == l->h.index) p->rwlock.written = l->written_next;
+	else {
+		prev = (RWLOCK *)object_at(&rwlocks, p->rwlock.written);
+		while (prev->written_next != l->h.index)
+			prev = (RWLOCK *)object_at(&rwlocks, prev->written_next);
+		prev->written_next = l->written_next;
+	}
+	l->writer = NULL;
+}
+
+/*** Read hold of process p on a lock ***/
+// NULL if p has none; holds of destroyed locks met on the way
+// are freed
+READ_HOLD *find_read_hold(PCB *p, rwlock_t key) {
+	uint32_t i = p->rwlock.reading;
+	READ_HOLD *r;
+
+	while (i != 0) {
+		r = (READ_HOLD *)object_at(&read_holds, i);
+		i = r->h.next;
+		if (r->lock == key) return r;
+		if (get_rwlock(r->lock) == NULL) free_object(&read_holds, &r->h, &p->rwlock.reading);
+	}
+	return NULL;
+}
+
+/*** Cleanup reader-writer locks for a process ***/
+// Locks held by p are released, and the ones created by p are
+// destroyed; only those locks are visited
+void free_rwlocks(PCB *p) {
+	RWLOCK *l;
+	READ_HOLD *r;
+
+	// remove from wait queue, if any; processes queued behind p may
+	// now get the lock
+	if (p->rwlock.wait_on != 0) {
+		l = get_rwlock(p->rwlock.wait_on);
+		p->rwlock.wait_on = 0;
+		if (l != NULL) {
+			remove_queue_item(&l->waitq, &p->rwlock.wait_node);
+			grant_rwlock(l);
+		}
+	}
+
+	// release locks held for writing
+	while (p->rwlock.written != 0) {
+		l = (RWLOCK *)object_at(&rwlocks, p->rwlock.written);
+		drop_write(l);
+		grant_rwlock(l);
+	}
+
+	// release locks held for reading
+	while (p->rwlock.reading != 0) {
+		r = (READ_HOLD *)object_at(&read_holds, p->rwlock.reading);
+		l = get_rwlock(r->lock);
+		if (l != NULL) l->readers -= r->count;
+		free_object(&read_holds, &r->h, &p->rwlock.reading);
+		if (l != NULL) grant_rwlock(l);
+	}
+
+	while (p->rwlock.created != 0)
+		rwlock_destroy(object_handle(object_at(&rwlocks, p->rwlock.created)), p);
+}
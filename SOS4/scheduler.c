@@ -15,67 +15,265 @@ extern PDE *k_page_directory;	// from lmemman.c
 PCB console;	// PCB of the console (==kernel)
 PCB *current_process; // the currently running process
 PCB *processq_next = NULL; // the next user program to run
+PCB *reclaimq = NULL;	// removed processes whose memory is yet to be freed
+PCB *pid_table[PID_BUCKETS];	// processes by pid (hash chains)
+PCB *direct_next = NULL;	// process to switch to without scheduling (see switch_directly)
 
 void init_scheduler() {
+	int i;
+
 	current_process = &console; // the first process is the console
+	for (i=0; i<PID_BUCKETS; i++) pid_table[i] = NULL;
 }
 
 /*** Add process to process queue ***/
 // Returns pointer to added process
-
-/** DO NOT UNCOMMENT THE FOLLOWING **/
-/*
 PCB *add_to_processq(PCB *p) {
 	
-	// you implemented this in a previous assignment
-	...
-		
+	disable_interrupts(); // process queue is modified by the scheduler too
+
+	if (processq_next == NULL) { // first process in queue
+		processq_next = p;
+		p->prev_PCB = p;
+		p->next_PCB = p;
+	}
+	else { // insert before processq_next, i.e. at the end of the queue
+		p->next_PCB = processq_next;
+		p->prev_PCB = processq_next->prev_PCB;
+		processq_next->prev_PCB->next_PCB = p;
+		processq_next->prev_PCB = p;
+	}
+	register_process(p);
+
+	enable_interrupts();
+
+	return p;
 }
-*/
 
 /*** Remove a TERMINATED process from process queue ***/
 // Returns pointer to the next process in process queue
-
-/** DO NOT UNCOMMENT THE FOLLOWING **/
-/*
+// The memory of the process is not freed here when DEFERRED_RECLAIM
+// is set; the process is put in the reclaim queue instead and its
+// pages are returned later by reclaim_processes
 PCB *remove_from_processq(PCB *p) {
 	PCB *ret;
 
-	// you implemented this in a previous assignment
-	...
+	if (p->next_PCB == p) ret = NULL; // last process in queue
+	else {
+		p->prev_PCB->next_PCB = p->next_PCB;
+		p->next_PCB->prev_PCB = p->prev_PCB;
+		ret = p->next_PCB;
+	}
 
 	// free synchronization primitives
+	free_wait_any(p); // first, so that p is not served by the others
 	free_mutex_locks(p); 
 	free_semaphores(p);
+	free_barriers(p);
+	free_conditions(p);
+	free_rwlocks(p);
+	free_pipes(p);
+	free_futexes(p);
 	free_shared_memory(p);
+	free_ipc(p);
+	unregister_process(p);
+	if (direct_next == p) direct_next = NULL;
+
+	// load kernel page directory; the page directory of p may be
+	// in CR3 (last process to run) and is about to be freed
+	load_CR3((uint32_t)k_page_directory-KERNEL_BASE);
+
+	if (DEFERRED_RECLAIM) { 
+		p->next_PCB = reclaimq;
+		reclaimq = p;
+	}
+	else reclaim_process(p);
+
+	return ret;
+}
+
+/*** Free all memory used by a removed process ***/
+void reclaim_process(PCB *p) {
+	PDE *page_directory = (PDE *)((uint32_t) p->mem.page_directory + KERNEL_BASE);
+	uint32_t pd_frame = (uint32_t)p->mem.page_directory & 0xFFFFF000;
 
 	// free used pages
-	dealloc_all_pages((PDE *)((uint32_t) p->mem.page_directory + KERNEL_BASE));
+	dealloc_all_pages(page_directory);
+	release_image(p->mem.image);
 	// free page used to store PCB
-	dealloc_page((void *)p,(PDE *)((uint32_t) p->mem.page_directory + KERNEL_BASE));
+	dealloc_page((void *)p,page_directory);
 	// free frame used to store page directory
-	dealloc_frames((void *)((uint32_t)p->mem.page_directory & 0xFFFFF000), 1);
+	dealloc_frames((void *)pd_frame, 1);
+}
 
-	// load kernel page directory
-	load_CR3((uint32_t)k_page_directory-KERNEL_BASE);
+/*** Free memory of processes in the reclaim queue ***/
+// Called by the console when it has nothing else to do;
+// one process is reclaimed per call so that interrupts are
+// not disabled for too long
+void reclaim_processes(void) {
+	PCB *p;
 
-	return ret;
+	if (reclaimq == NULL) return;
+
+	disable_interrupts(); // scheduler adds to reclaim queue
+
+	p = reclaimq;
+	if (p != NULL) {
+		reclaimq = p->next_PCB;
+		reclaim_process(p);
+	}
+
+	enable_interrupts();
+}
+
+/*** Free memory of all processes in the reclaim queue ***/
+// Called before the console allocates memory (commands, run), so
+// that terminated processes do not make an allocation fail; the
+// queue is drained one process at a time, as in reclaim_processes
+void reclaim_all_processes(void) {
+	while (reclaimq != NULL) reclaim_processes();
 }
-*/
 
 /*** Schedule a process ***/
 // Toggle between console and a user program;
-// user program is chosen from the process queue in
-// round-robin fashion
-
-/** DO NOT UNCOMMENT THE FOLLOWING **/
-/*
+// user program is the READY process with the highest effective
+// priority; processes of the same priority are chosen from the
+// process queue in round-robin fashion
 void schedule_something() { // no interruption when here
-	
-	// you implemented this in a previous assignment
-	...
+	PCB *begin_queue;
+	PCB *p;
+	PCB *best = NULL;
+
+	// a process woken up by message passing (or handed a lock, see
+	// wakeup_handoff) runs right away, unless the process that woke
+	// it up can go on and has higher priority
+	if (direct_next != NULL) {
+		p = direct_next;
+		direct_next = NULL;
+		if (p->state == READY && current_process != &console &&
+		    (current_process->state != READY ||
+		     p->priority.effective >= current_process->priority.effective)) {
+			current_process = p;
+			p->state = RUNNING;
+			switch_to_user_process(p);
+		}
+	}
+
+	// console runs every other time, and whenever there is
+	// nothing else to run
+	if (current_process != &console || processq_next == NULL) {
+		current_process = &console;
+		console.state = RUNNING;
+		switch_to_kernel_process(&console);
+	}
+
+	// remove process from process queue if it has terminated
+	if (processq_next->state == TERMINATED) {
+		processq_next = remove_from_processq(processq_next);
+		schedule_something();
+	}
+
+	// a new process needs its program loaded from disk, unless another
+	// process running the same program has already done so; the
+	// process waits while the disk reads the program
+	if (processq_next->state == NEW) {
+		switch (load_image(processq_next)) { // in image.c
+			case IMAGE_LOADED: processq_next->state = READY; break;
+			case IMAGE_LOADING: processq_next->state = WAITING; break;
+			default:
+				sys_printf("run: Load error (%u,%u).\n",processq_next->disk.LBA,
+								      processq_next->disk.n_sectors);
+				processq_next->state = TERMINATED;
+		}
+	}
+
+	// run the READY process of highest priority, starting the search
+	// at the next process in the queue; sleeping processes whose time
+	// is over are woken up on the way
+	begin_queue = processq_next;
+	p = begin_queue;
+	do {
+		if (p->state == WAITING && p->sleep_end != 0 && get_epochs() >= p->sleep_end) {
+			if (p->semaphore.wait_on != 0) semaphore_timeout(p); // timed DOWN failed
+			if (p->wait_any.n != 0) wait_any_timeout(p); // nothing in the set fired
+			p->state = READY;
+			p->sleep_end = 0;
+		}
+		if (p->state == READY && (best == NULL || 
+		    p->priority.effective > best->priority.effective))
+			best = p;
+		p = p->next_PCB;
+	} while (p != begin_queue);
+
+	if (best != NULL) {
+		processq_next = best->next_PCB;
+		current_process = best;
+		best->state = RUNNING;
+		switch_to_user_process(best);
+	}
+
+	// no READY process; run the console
+	processq_next = begin_queue->next_PCB;
+	current_process = &console;
+	console.state = RUNNING;
+	switch_to_kernel_process(&console);
+}
+
+/*** Set base priority of a process ***/
+// Effective priority may stay higher while p holds a mutex that
+// higher priority processes are waiting on
+void set_priority(PCB *p, uint8_t priority) {
+	if (priority >= PRIORITY_LEVELS) priority = PRIORITY_LEVELS - 1;
+
+	p->priority.base = priority;
+	update_priority(p); // in mutex.c
+}
+
+/*** Add process to the pid table ***/
+void register_process(PCB *p) {
+	p->pid_next = pid_table[p->pid % PID_BUCKETS];
+	pid_table[p->pid % PID_BUCKETS] = p;
+}
+
+/*** Remove process from the pid table ***/
+void unregister_process(PCB *p) {
+	PCB *q = pid_table[p->pid % PID_BUCKETS];
+
+	if (q == p) pid_table[p->pid % PID_BUCKETS] = p->pid_next;
+	else {
+		while (q != NULL && q->pid_next != p) q = q->pid_next;
+		if (q != NULL) q->pid_next = p->pid_next;
+	}
+}
+
+/*** Process with a given pid ***/
+// NULL if there is no such process
+PCB *find_process(uint32_t pid) {
+	PCB *p;
+
+	for (p=pid_table[pid % PID_BUCKETS]; p!=NULL; p=p->pid_next)
+		if (p->pid == pid) return p;
+	return NULL;
+}
+
+/*** Run a process next without scheduling ***/
+// Called during a system call that woke up process p; p runs as
+// soon as the system call is done (see schedule_something)
+void switch_directly(PCB *p) {
+	direct_next = p;
+}
+
+/*** Hand the processor over to a woken up process ***/
+// With WAKEUP_HANDOFF, a process that wakes up others by releasing a
+// mutex or semaphore during a system call gives the rest of its
+// quantum to the first of them (if its priority is not lower, see
+// schedule_something), instead of letting it wait for its turn in
+// the process queue; the lock has already been given to the woken
+// up process, so it does not have to race for it
+void wakeup_handoff(PCB *from, PCB *to) {
+	if (WAKEUP_HANDOFF && from == current_process && direct_next == NULL)
+		switch_directly(to);
 }
-*/
 
 /*** Switch to kernel process described by the PCB ***/
 // We will use the "fastcall" keyword to force GCC to pass 
@@ -110,14 +308,11 @@ __attribute__((fastcall)) void switch_to_kernel_process(PCB *p)  {
 // We will use the "fastcall" keyword to force GCC to pass 
 // the pointer in register ECX
 // a ring change will be necessary here
-
-/** DO NOT UNCOMMENT THE FOLLOWING **/
-/*
 __attribute__((fastcall)) void switch_to_user_process(PCB *p) {
 
 	// Note: user code and data GDTs already set up in startup.S
 	// load process page table
-	asm volatile ("movl %0, %%eax\n": :"m"((uint32_t)p->mem.page_directory));
+	asm volatile ("movl %0, %%eax\n": :"m"(p->mem.page_directory));
 	asm volatile ("movl %eax, %cr3\n");
 
 	// VirtualBox nonsense: if we do not touch the TSS stack
@@ -125,9 +320,35 @@ __attribute__((fastcall)) void switch_to_user_process(PCB *p) {
 	// corresponding to this address
 	asm volatile ("movb $0, 0xBFBFFFFF\n");
 
-	... 
-	// you implemented this in a previous assignment
-}
-*/
+	// load CPU state from process PCB
+	asm volatile ("movl %0, %%edi\n": :"m"(p->cpu.edi));
+	asm volatile ("movl %0, %%esi\n": :"m"(p->cpu.esi));
+	asm volatile ("movl %0, %%eax\n": :"m"(p->cpu.eax));
+	asm volatile ("movl %0, %%ebx\n": :"m"(p->cpu.ebx));
+	asm volatile ("movl %0, %%edx\n": :"m"(p->cpu.edx));
+	asm volatile ("movl %0, %%ebp\n": :"m"(p->cpu.ebp));
+
+	// switching to Ring 3; IRET requires the following in stack (see IRET details)
+	asm volatile ("pushl %0\n": :"m"(p->cpu.ss));
+	asm volatile ("pushl %0\n": :"m"(p->cpu.esp));
+	asm volatile ("pushl %0\n": :"m"(p->cpu.eflags));
+	asm volatile ("pushl %0\n": :"m"(p->cpu.cs));
+	asm volatile ("pushl %0\n": :"m"(p->cpu.eip));
+
+	// this should be the last one to be copied
+	asm volatile ("movl %0, %%ecx\n": :"m"(p->cpu.ecx));
 
+	// user data segment selectors (RPL=3)
+	asm volatile ("pushl $0x23\n"
+		      "pushl $0x23\n"
+		      "pushl $0x23\n"
+		      "pushl $0x23\n"
+		      "popl %gs\n"
+		      "popl %fs\n"
+		      "popl %es\n"
+		      "popl %ds\n");
 
+	// issue IRET; see IRET details
+	asm volatile("sti\n"); // interrupts cleared in timer/syscall handler
+	asm volatile("iretl\n"); // this completes the timer/syscall interrupt
+}
@@ -1,65 +1,66 @@
 ///////////////////////////////////////////////////////
 // Semaphore implementation
-// This implementation provides SEM_MAXNUMBER semaphores
-// for use by user processes; the semaphore number is specified 
-// using an 8-bit number (called key), which restricts us to 
-// have up to 256 semaphore variables
-// DO NOT use a semaphore object that has not been created; the functions
-// always return in such cases
-// TODO: Allow user process to create own semaphore object
+// This implementation provides semaphores for use by user
+// processes; a semaphore is specified using a 32-bit handle
+// (called key) from the semaphore handle table (see handle.c),
+// which grows as more semaphores are created
+// Using a semaphore that has not been created (or has been
+// destroyed) is harmless; the functions always return in such cases
 
 #include "kernel_only.h"
 
-SEMAPHORE sem[SEM_MAXNUMBER];	// the semaphore locks; maximum 256 of them 
+HANDLE_TABLE semaphores;	// the semaphores
 
-/*** Initialize all semaphorees ***/
+/*** Initialize semaphore table ***/
 void init_semaphores() {
-	int i;
-	for (i=0; i<SEM_MAXNUMBER; i++) {
-		init_queue(&(sem[i].waitq));
-		sem[i].value = 0;
-		sem[i].available = TRUE;
-	}
-	sem[0].available = FALSE;
+	init_handle_table(&semaphores, sizeof(SEMAPHORE));
+}
+
+/*** Semaphore with a given key ***/
+// Returns NULL if there is no such semaphore
+SEMAPHORE *get_semaphore(sem_t key) {
+	return (SEMAPHORE *)get_object(&semaphores, key);
 }
 
 /*** Create a semaphore object ***/
 // At least one of the cooperating processes (typically
 // the main process) should create the semaphore before use.
-// The function returns 0 if no semaphore object is
-// available; otherwise the semaphore object number is returned 
+// The function returns 0 if no memory is available for a new
+// semaphore; otherwise the key of the semaphore is returned 
 // init_value is the start value of the semaphore
 sem_t semaphore_create(uint8_t init_value, PCB *p) {
-	// TODO: see background material on what this function should do
-	sem_t s = 0;
-	for (s = 0; s < 256; s++){
-		if (sem[(uint8_t)s].available == TRUE) {
-			sem[(uint8_t)s].available = FALSE;
-			sem[(uint8_t)s].creator = p->pid;
-			sem[(uint8_t)s].value = init_value;
-			QUEUE *q = &sem[(uint8_t)s].waitq;
-			init_queue(q);
-			return s;
-		}
-	}
-	return 0;
-
-	// TODO: comment the following line before you start working
-	//return 0;
+	SEMAPHORE *s = (SEMAPHORE *)alloc_object(&semaphores, p, &p->semaphore.created);
+
+	if (s == NULL) return 0;
+
+	s->value = init_value;
+	init_queue(&s->waitq);
+	reset_lock_stats(&s->stats);
+	return object_handle(&s->h);
 }
 
 /*** Destroy a semaphore with a given key ***/
 // This should be called by the process who created the semaphore
-// using semaphore_create; the function makes the semaphore key available
-// for use by other creators
-// Semaphore is automatically destroyed if creator process dies; creator
-// process should always destroy a semaphore when no other process is
-// using it; otherwise the behavior is undefined
+// using semaphore_create; the key becomes invalid
+// Semaphore is automatically destroyed if creator process dies;
+// processes still waiting on it are woken up without getting it
 void semaphore_destroy(sem_t key, PCB *p) {
-	// TODO: see background material on what this function should do
-	if (sem[(uint8_t)key].creator == p->pid) {
-		sem[(uint8_t)key].available = TRUE;
+	SEMAPHORE *s = get_semaphore(key);
+	WAIT_NODE *n;
+
+	if (s == NULL || s->h.creator != p->pid) return;
+
+	while ((n = s->waitq.head) != NULL) {
+		remove_queue_item(&s->waitq, n);
+		if (n->index != WAIT_SINGLE) wait_any_cancel(n); // in wait.c
+		else {
+			n->p->semaphore.wait_on = 0;
+			n->p->sleep_end = 0; // cancel timeout, if any
+			n->p->cpu.edx = FALSE; // return value of a timed DOWN
+			n->p->state = READY;
+		}
 	}
+	free_object(&semaphores, &s->h, &p->semaphore.created);
 }
 
 /*** DOWN operation on a semaphore ***/
@@ -67,48 +68,114 @@ void semaphore_destroy(sem_t key, PCB *p) {
 // number <key>; otherwise the process is queued and FALSE is
 // returned.
 bool semaphore_down(sem_t key, PCB *p) {
-	// TODO: see background material on what this function should do
-	if (sem[(uint8_t)key].value != 0){
-		sem[(uint8_t)key].value--;
-		return TRUE;
-	}
-	else{
-		QUEUE *q = &sem[(uint8_t)key].waitq;
-		p->semaphore.queue_index = enqueue(q, p);
-		p->semaphore.wait_on = (uint8_t)key;
-		return FALSE;
+	return semaphore_down_n(key, 1, p);
+}
+
+/*** DOWN operation by n on a semaphore ***/
+// Returns TRUE if the value of semaphore number <key> can be
+// decreased by n at once; otherwise the process is queued and FALSE
+// is returned. Waiting processes are served in FIFO order, so a 
+// process does not get ahead of one queued earlier
+bool semaphore_down_n(sem_t key, uint32_t n, PCB *p) {
+	SEMAPHORE *s = get_semaphore(key);
+
+	if (s == NULL) return TRUE; // do not wait on a semaphore that does not exist
+
+	if (s->waitq.count == 0 && s->value >= n){
+		s->value -= n;
+		lock_acquired(&s->stats, NULL);
+		return TRUE;
+	}
+	else{
+		enqueue(&s->waitq, &p->semaphore.wait_node);
+		p->semaphore.wait_on = key;
+		p->semaphore.count = n;
+		return FALSE;
 	}
-	// TODO: comment the following line before you start working
-	//return TRUE;
 }
 
 /*** UP operation on a sempahore ***/
 void semaphore_up(sem_t key, PCB *p) {
-	// TODO: see background material on what this function should do
-	sem[(uint8_t)key].value++;
-	QUEUE *q = &sem[(uint8_t)key].waitq;
-	PCB *next_p = dequeue(q);
-	if (next_p != NULL){
-		next_p->semaphore.wait_on = -1;
-		next_p->state = READY;
-		sem[(uint8_t)key].value--;
-	}
+	semaphore_up_n(key, 1, p);
 }
 
-/*** Cleanup semaphorees for a process ***/
-void free_semaphores(PCB *p) {
-	int i;
+/*** UP operation by n on a semaphore ***/
+// Waiting processes are woken up (in FIFO order) as long as the
+// value is enough for the process at the head of the queue
+void semaphore_up_n(sem_t key, uint32_t n, PCB *p) {
+	SEMAPHORE *s = get_semaphore(key);
+	WAIT_NODE *next;
+	uint32_t count;
+
+	if (s == NULL) return;
+
+	s->value += n;
+	while ((next = s->waitq.head) != NULL) {
+		// a process waiting on many objects (see wait.c) needs 1
+		count = (next->index == WAIT_SINGLE)? next->p->semaphore.count : 1;
+		if (count > s->value) break;
 
-	for (i=1; i<SEM_MAXNUMBER; i++) {
-		// see if process is creator of the semaphore
-		if (p->pid == sem[i].creator) semaphore_destroy((sem_t)i,p);
+		remove_queue_item(&s->waitq, next);
+		s->value -= count;
+		lock_acquired(&s->stats, next);
+		if (next->index != WAIT_SINGLE) wait_any_fired(next); // in wait.c
+		else {
+			next->p->semaphore.wait_on = 0;
+			next->p->sleep_end = 0; // cancel timeout, if any
+			next->p->state = READY;
+		}
+		wakeup_handoff(p, next->p); // in scheduler.c; first one woken up only
 	}
+}
 
-	// remove from wait queue, if any
-	if (p->semaphore.wait_on != -1) 
-		remove_queue_item(&sem[p->semaphore.wait_on].waitq, p->semaphore.queue_index);
-	
+/*** DOWN operation on a semaphore if it is possible now ***/
+// Returns FALSE (process is not queued) if the value is 0, others
+// are waiting, or the semaphore does not exist
+bool semaphore_trydown(sem_t key) {
+	SEMAPHORE *s = get_semaphore(key);
+
+	if (s == NULL || s->waitq.count != 0 || s->value == 0) return FALSE;
+
+	s->value--;
+	lock_acquired(&s->stats, NULL);
+	return TRUE;
 }
 
+/*** Wait queue of a semaphore ***/
+// NULL if there is no such semaphore
+QUEUE *semaphore_queue(sem_t key) {
+	SEMAPHORE *s = get_semaphore(key);
 
+	if (s == NULL) return NULL;
+	return &s->waitq;
+}
+
+/*** Give up waiting on a semaphore ***/
+// Called by the scheduler when the timeout of a process waiting
+// in semaphore_down_timeout is over; the DOWN fails (returns FALSE)
+void semaphore_timeout(PCB *p) {
+	sem_t key = p->semaphore.wait_on;
 
+	remove_queue_item(semaphore_queue(key), &p->semaphore.wait_node);
+	p->semaphore.wait_on = 0;
+	p->cpu.edx = FALSE; // return value
+
+	// processes queued behind p may now be served
+	semaphore_up_n(key, 0, p);
+}
+
+/*** Cleanup semaphores for a process ***/
+// Only the semaphores created by p are visited
+void free_semaphores(PCB *p) {
+	sem_t key = p->semaphore.wait_on;
+
+	// remove from wait queue, if any
+	if (key != 0) {
+		remove_queue_item(semaphore_queue(key), &p->semaphore.wait_node);
+		p->semaphore.wait_on = 0;
+		semaphore_up_n(key, 0, p); // serve those queued behind p
+	}
+
+	while (p->semaphore.created != 0)
+		semaphore_destroy(object_handle(object_at(&semaphores, p->semaphore.created)), p);
+}
@@ -1,156 +1,369 @@
 ///////////////////////////////////////////////////////
 // Shared Memory Implementation
-// This implementation provides SHMEM_MAXNUMBER shared memory
-// objects for use by user processes; the object number is specified 
-// using an 8-bit number (called key), which restricts us to have up to
-// 256 shared memory objects.
-// Shared memory objects persist until the number of references to 
-// it comes down to zero, when the space is deallocated
-// TODO: Allow object creation using alphanumeric keys
+// This implementation provides shared memory objects for use by
+// user processes; an object is found either by an 8-bit number
+// (called key; up to SHMEM_MAXNUMBER of them) or by a name of up to
+// SHM_NAMELEN-1 characters. Objects are kept in a handle table (see
+// handle.c), so there can be thousands of them, and names are looked
+// up in a hash table of SHM_HASH_BUCKETS chains
+// A process can create or attach to up to SHM_MAXATTACH objects
+// (segments) at a time, each of up to SHM_MAXSIZE bytes; segments are
+// mapped between SHM_BEGIN and SHM_END, at an address asked for by the
+// process or at the lowest free one
+// Shared memory objects persist until the number of references to
+// it comes down to zero, when the space is deallocated; a name is a
+// reference too, so a named object lives on, even when nobody is
+// attached, until the name is unlinked. The object holds a reference
+// to each of its frames (besides the ones of the mappings), so the
+// frames stay with it while nobody is attached
 
 #include "kernel_only.h"
 
-SHMEM shm[SHMEM_MAXNUMBER];	// the shared memory objects; maximum 256 of them
+HANDLE_TABLE shm_objects;	// the shared memory objects
+uint32_t shm_list;		// all objects (handle table list)
+uint32_t shm_key[SHMEM_MAXNUMBER];	// object of each key; 0 if none
+uint32_t *shm_hash;		// first object of each hash chain; 0 if none
 
 /*** Initialize all shared memory objects ***/
 void init_shared_memory() {
 	int i;
-	for (i=0; i<SHMEM_MAXNUMBER; i++) {
-		shm[i].refs = 0;
-		shm[i].base = NULL;
-	}
+
+	init_handle_table(&shm_objects, sizeof(SHMEM));
+	shm_list = 0;
+	for (i=0; i<SHMEM_MAXNUMBER; i++) shm_key[i] = 0;
+
+	shm_hash = (uint32_t *)alloc_kernel_pages(SHM_HASH_BUCKETS*4/4096);
+	for (i=0; i<SHM_HASH_BUCKETS; i++) shm_hash[i] = 0;
 }
 
 /*** Create a shared memory object ***/
-// Shared memory area will always start at logical 0x80000000 (SHM_BEGIN);
-// a process can create only one shared memory object at a time with a
-// maximum size of 4MB
+// The object is mapped at logical address <addr>, or at the lowest
+// free address if <addr> is 0; the address is returned (NULL if the
+// object cannot be created)
 // At least one process must create the shared memory before others
 // can use it using the key
-void  *shm_create(uint8_t key, uint32_t size, PCB *p) {
+void  *shm_create(uint8_t key, uint32_t size, uint32_t addr, PCB *p) {
+	SHMEM *s;
+
+	if (shm_key[key] != 0) return NULL; // key in use
+
+	s = new_shm(size, &addr, p);
+	if (s == NULL) return NULL;
+
+	s->keyed = TRUE;
+	s->key = key;
+	shm_key[key] = s->h.index;
+	return (void *)addr; // return logical address of shared memory area start
+}
+
+/*** Attach to a shared memory area ***/
+// A process can attach to an already created shared memory area using
+// the key; mode is SHM_READ_ONLY or SHM_READ_WRITE. The area is mapped
+// at logical address <addr>, or at the lowest free address if <addr>
+// is 0; the address is returned (NULL if the area cannot be attached)
+void *shm_attach(uint8_t key, uint32_t mode, uint32_t addr, PCB *p) {
+	if (shm_key[key] == 0) return NULL; // not yet created
+
+	return map_shm((SHMEM *)object_at(&shm_objects, shm_key[key]), mode, addr, p);
+}
+
+/*** Create or open a named shared memory object ***/
+// name must be shorter than SHM_NAMELEN (see copy_shm_name)
+// If there is no object with the name, one of <size> bytes is created
+// (size 0: do not create); the object is mapped at the lowest free
+// address with <mode> (always read-write for the creator), which is
+// returned. NULL if the object cannot be created or attached
+void *shm_open(char *name, uint32_t size, uint32_t mode, PCB *p) {
+	SHMEM *s = find_shm(name);
+	uint32_t addr = 0;
+	uint32_t h, i;
+
+	if (s != NULL) return map_shm(s, mode, 0, p);
+	if (size == 0) return NULL;
+
+	s = new_shm(size, &addr, p);
+	if (s == NULL) return NULL;
+
+	for (i=0; name[i] != 0; i++) s->name[i] = name[i];
+	s->name[i] = 0;
+	s->refs++; // reference held by the name
+	h = shm_name_hash(name);
+	s->hash_next = shm_hash[h];
+	shm_hash[h] = s->h.index;
+	return (void *)addr;
+}
+
+/*** Remove the name of a shared memory object ***/
+// The object is deleted once no process is attached to it; the name
+// can be used for a new object right away; any process may remove
+// a name, as with the names of files. Returns FALSE if there is no
+// object with the name
+bool shm_unlink(char *name) {
+	SHMEM *s = find_shm(name);
+	uint32_t h = shm_name_hash(name);
+	SHMEM *prev;
+
+	if (s == NULL) return FALSE;
+
+	// remove from hash chain
+	if (shm_hash[h] == s->h.index) shm_hash[h] = s->hash_next;
+	else {
+		prev = (SHMEM *)object_at(&shm_objects, shm_hash[h]);
+		while (prev->hash_next != s->h.index)
+			prev = (SHMEM *)object_at(&shm_objects, prev->hash_next);
+		prev->hash_next = s->hash_next;
+	}
+	s->name[0] = 0;
+
+	release_shm(s);
+	return TRUE;
+}
+
+/***  Unlink from a shared memory area ***/
+// The area is the one mapped at logical address <addr>; returns
+// FALSE if there is no such area
+bool shm_detach(uint32_t addr, PCB *p) {
+	uint32_t i;
+	SHMEM *s;
+
+	for (i=0; i<p->shared_memory.n; i++)
+		if (p->shared_memory.segment[i].addr == addr) break;
+	if (i == p->shared_memory.n) return FALSE; // process has not attached an area there
+
+	s = (SHMEM *)object_at(&shm_objects, p->shared_memory.segment[i].object);
+	for (i++; i<p->shared_memory.n; i++) // keep the list sorted
+		p->shared_memory.segment[i-1] = p->shared_memory.segment[i];
+	p->shared_memory.n--;
+
+	unmap_shm(p, s, addr, shm_pages(s));
+	release_shm(s);
+	return TRUE;
+}
+
+/*** Make a new shared memory object ***/
+// The object of <size> bytes is mapped read-write in process p at
+// *addr (lowest free address if 0); the address is put in *addr.
+// Returns NULL if the object cannot be created
+SHMEM *new_shm(uint32_t size, uint32_t *addr, PCB *p) {
+	uint32_t i, n_pages, list_pages;
+	uint32_t *frames;
+	SHMEM *s;
+
 	// some sanity checks: size should not be zero; size should not be
-	// more than 4MB; object should not be in use; process should not
-	// have created another shared memory object
-	if (size == 0 || size > 0x400000 || shm[key].refs != 0) return NULL; 
-	if (p->shared_memory.created) return NULL; // already created one area; unlink from it first
+	// more than SHM_MAXSIZE; process should have room for another segment
+	if (size == 0 || size > SHM_MAXSIZE) return NULL;
+	if (p->shared_memory.n == SHM_MAXATTACH) return NULL;
 
 	// how many pages does <size> bytes take
-	uint32_t n_pages = size/4096;   
+	n_pages = size/4096;
 	if (size % 4096 != 0) n_pages++;
 
-	// logical address pointer of page directory
-	PDE *page_directory = (PDE *)((uint32_t)p->mem.page_directory + KERNEL_BASE);
+	*addr = find_shm_space(p, *addr, n_pages);
+	if (*addr == 0) return NULL;
+
+	// kernel pages to remember the frames (1024 in a page) of the object
+	list_pages = (n_pages + 1023)/1024;
+	frames = (uint32_t *)alloc_kernel_pages(list_pages);
+	if (frames == NULL) return NULL;
 
-	// allocate pages for user process; alloc_user_pages will update the page 
+	s = (SHMEM *)alloc_object(&shm_objects, p, &shm_list);
+	if (s == NULL) {
+		dealloc_frames((void *)((uint32_t)frames - KERNEL_BASE), list_pages);
+		return NULL;
+	}
+
+	// allocate pages for user process; alloc_user_pages will update the page
 	// directory and page tables as necessary
-	if (alloc_user_pages(n_pages, SHM_BEGIN, page_directory, PTE_READ_WRITE)==NULL)
+	if (alloc_user_pages(n_pages, *addr, (PDE *)((uint32_t)p->mem.page_directory + KERNEL_BASE),
+			     PTE_READ_WRITE)==NULL) {
+		dealloc_frames((void *)((uint32_t)frames - KERNEL_BASE), list_pages);
+		free_object(&shm_objects, &s->h, &shm_list);
 		return NULL;
+	}
 
-	
-	// remember the start frame address of the allocated memory;
-	// this will be used when other processes attach to this shared memory object
-	uint32_t pd_entry = SHM_BEGIN >> 22; // 0x200
-	uint32_t pt_entry = (SHM_BEGIN >> 12) & 0x000003FF; // 0x0  
-	PTE *l_pages = (PTE *)((page_directory[pd_entry] & 0xFFFFF000) + KERNEL_BASE);
-	shm[key].base = l_pages[pt_entry] & 0xFFFFF000;
-	shm[key].size = size;
+	// remember the frame addresses of the allocated memory (they need not be
+	// contiguous); this will be used when other processes attach to this
+	// shared memory object
+	for (i=0; i<n_pages; i++) {
+		frames[i] = *get_pte(p, *addr + i*4096) & 0xFFFFF000;
+		set_frame_type((void *)frames[i], 1, FRAME_SHMEM);
+		ref_frames((void *)frames[i], 1); // reference held by the object
+	}
+	s->frames = frames;
+	s->size = size;
+	s->refs = 1;
+	s->keyed = FALSE;
+	s->name[0] = 0;
 
-	shm[key].refs++;
-	p->shared_memory.created = TRUE;
-	p->shared_memory.key = key;
+	add_shm_attachment(p, s->h.index, *addr);
+	return s;
+}
 
-	return (void *)SHM_BEGIN; // return logical address of shared memory area start
+/*** Map a shared memory object in a process ***/
+// Mapped with <mode> at logical address <addr>, or at the lowest free
+// address if <addr> is 0; the address is returned (NULL if the object
+// cannot be mapped)
+void *map_shm(SHMEM *s, uint32_t mode, uint32_t addr, PCB *p) {
+	uint32_t i, n_pages;
+	PTE *pte;
+
+	if (p->shared_memory.n == SHM_MAXATTACH) return NULL;
+
+	n_pages = shm_pages(s);
+	addr = find_shm_space(p, addr, n_pages);
+	if (addr == 0) return NULL;
+
+	// modify page table entries to point to shared frames
+	// CAUTION: if page is already mapped, it will not be changed
+	for (i=0; i<n_pages; i++) {
+		pte = alloc_shm_pte(p, addr + i*4096);
+		if (pte == NULL) { // out of memory for page tables
+			unmap_shm(p, s, addr, i);
+			return NULL;
+		}
+		if ((uint32_t)(*pte & PTE_PRESENT) == 0) {
+			*pte = s->frames[i] | (mode & PTE_READ_WRITE) | PTE_PRESENT | PTE_USER_SUPERVISOR;
+			ref_frames((void *)s->frames[i], 1);
+		}
+	}
+
+	s->refs++;
+	add_shm_attachment(p, s->h.index, addr);
+	return (void *)addr;
 }
 
-/*** Attach to a shared memory area ***/
-// A process can attach to an already created shared memory area using
-// the key; mode is SHM_READ_ONLY or SHM_READ_WRITE
-void *shm_attach(uint8_t key, uint32_t mode, PCB *p) {
-	int i;
-	
-	if (shm[key].refs == 0) return NULL; // not yet created
+/*** Drop a reference to a shared memory object ***/
+// The object is deleted when the last reference goes away
+void release_shm(SHMEM *s) {
+	s->refs--;
+	if (s->refs != 0) return;
 
-	if (p->shared_memory.created) return NULL; // already attached to an object
-	
-	// size of shared memory in number of pages
-	uint32_t n_pages = shm[key].size/4096;
-	if (shm[key].size % 4096 != 0) n_pages++;
+	// drop the references of the object to its frames, and free
+	// frame list
+	dealloc_frames_scattered(s->frames, shm_pages(s));
+	dealloc_frames((void *)((uint32_t)s->frames - KERNEL_BASE), (shm_pages(s) + 1023)/1024);
+	s->frames = NULL;
 
-	// logical address pointer of page directory
-	PDE *page_directory = (PDE *)((uint32_t)p->mem.page_directory + KERNEL_BASE);
+	if (s->keyed) shm_key[s->key] = 0;
+	free_object(&shm_objects, &s->h, &shm_list);
+}
+
+/*** Find a named shared memory object ***/
+// NULL if there is no object with the name
+SHMEM *find_shm(char *name) {
+	uint32_t i = shm_hash[shm_name_hash(name)];
+	SHMEM *s;
+
+	while (i != 0) {
+		s = (SHMEM *)object_at(&shm_objects, i);
+		if (strcmp(s->name, name) == 0) return s;
+		i = s->hash_next;
+	}
+	return NULL;
+}
+
+/*** Hash chain of a name ***/
+// FNV-1a hash of the characters
+uint32_t shm_name_hash(char *name) {
+	uint32_t h = 2166136261u;
+
+	for (; *name != 0; name++) {
+		h ^= (uint8_t)*name;
+		h *= 16777619u;
+	}
+	return h % SHM_HASH_BUCKETS;
+}
+
+/*** Number of pages of a shared memory object ***/
+uint32_t shm_pages(SHMEM *s) {
+	uint32_t n_pages = s->size/4096;
+	if (s->size % 4096 != 0) n_pages++;
+	return n_pages;
+}
+
+/*** Find logical addresses for a shared memory area ***/
+// Checks that n_pages pages starting at <addr> are free in the shared
+// memory region of process p, or looks for the lowest such address if
+// <addr> is 0; returns the address, or 0 if there is no space
+uint32_t find_shm_space(PCB *p, uint32_t addr, uint32_t n_pages) {
+	uint32_t i, start, end;
+	uint32_t size = n_pages*4096;
+	SHMEM *s;
+
+	if (addr != 0 && ((addr & 0xFFF) != 0 || addr < SHM_BEGIN || addr >= SHM_END)) return 0;
 
-	// paging entries corresponding to shared memory base
-	uint32_t pd_entry = SHM_BEGIN >> 22; // 0x200
-	uint32_t pt_entry = (SHM_BEGIN >> 12) & 0x000003FF; // 0x0  
+	start = (addr != 0)? addr : SHM_BEGIN;
+	for (i=0; i<p->shared_memory.n; i++) { // segments are sorted by address
+		if (start + size <= p->shared_memory.segment[i].addr) break; // fits before segment i
 
-	// allocate space for page table, if needed
+		s = (SHMEM *)object_at(&shm_objects, p->shared_memory.segment[i].object);
+		end = p->shared_memory.segment[i].addr + shm_pages(s)*4096;
+		if (end <= start) continue; // segment i is below
+
+		if (addr != 0) return 0; // overlaps segment i
+		start = end;
+	}
+
+	if (start + size > SHM_END || start + size < start) return 0;
+	return start;
+}
+
+/*** Remember a shared memory area of process p ***/
+// The list is kept sorted by address
+void add_shm_attachment(PCB *p, uint32_t object, uint32_t addr) {
+	uint32_t i;
+
+	for (i=p->shared_memory.n; i>0 && p->shared_memory.segment[i-1].addr > addr; i--)
+		p->shared_memory.segment[i] = p->shared_memory.segment[i-1];
+
+	p->shared_memory.segment[i].object = object;
+	p->shared_memory.segment[i].addr = addr;
+	p->shared_memory.n++;
+}
+
+/*** Page table entry for a shared memory page ***/
+// Returns the page table entry of logical address <loc> in process p,
+// allocating the page table if needed; NULL if out of memory
+PTE *alloc_shm_pte(PCB *p, uint32_t loc) {
+	PDE *page_directory = (PDE *)((uint32_t)p->mem.page_directory + KERNEL_BASE);
+	uint32_t pd_entry = loc >> 22;
 	uint32_t pt_frame;
+
 	if ((uint32_t)(page_directory[pd_entry] & PDE_PRESENT) == 0) { // entry not present
 		// allocate space for page table and set entry
 		if ((pt_frame = (uint32_t)alloc_frames(1, KERNEL_ALLOC)) == NULL)
 			return NULL;
 
+		zero_out_pages((void *)(pt_frame + KERNEL_BASE), 1);
 		page_directory[pd_entry] = pt_frame | PDE_PRESENT | PDE_READ_WRITE | PDE_USER_SUPERVISOR;
-		zero_out_pages((void *)(pt_frame + KERNEL_BASE), 1); // just to be sure
-	}			
-		
-	// logical address pointer of page table
-	PTE *l_pages = (PTE *)((page_directory[pd_entry] & 0xFFFFF000) + KERNEL_BASE);
-	
-	// modify page table entries to point to shared frames
-	// CAUTION: if page is already mapped, it will not be changed
-	for (i=pt_entry; i<pt_entry+n_pages; i++) {
-		if ((uint32_t)(l_pages[i] & PTE_PRESENT) == 0)
-			l_pages[i] =  (shm[key].base + (i-pt_entry)*4096) | mode | PTE_PRESENT | PTE_USER_SUPERVISOR;
 	}
 
-	shm[key].refs++;
-	p->shared_memory.created = TRUE;
-	p->shared_memory.key = key;
-
-	return (void *)SHM_BEGIN; // return logical address of shared memory area start
+	return get_pte(p, loc);
 }
 
-/***  Unlink from a shared memory area ***/
-void shm_detach(PCB *p) {
-	int i;
-	if (p->shared_memory.created) { // only if process has attached to object
-		shm[p->shared_memory.key].refs--;
-		p->shared_memory.created = FALSE;
-	
-		// size of shared memory in number of pages
-		uint32_t n_pages = shm[p->shared_memory.key].size/4096;
-		if (shm[p->shared_memory.key].size % 4096 != 0) n_pages++;
-
-		// logical address pointer of page directory
-		PDE *page_directory = (PDE *)((uint32_t)p->mem.page_directory + KERNEL_BASE);
-
-		// paging entries corresponding to shared memory base
-		uint32_t pd_entry = SHM_BEGIN >> 22; // 0x200
-		uint32_t pt_entry = (SHM_BEGIN >> 12) & 0x000003FF; // 0x0  
-
-		// logical address pointer of page table
-		PTE *l_pages = (PTE *)((page_directory[pd_entry] & 0xFFFFF000) + KERNEL_BASE);
-
-		// remove page table entries;
-		// frames get deallocated only after the reference count becomes zero
-		for (i=pt_entry; i<pt_entry+n_pages; i++) {
-			l_pages[i] =  0;
-		}	
-
-		// free space if no more references 
-		if (shm[p->shared_memory.key].refs == 0) {
-			dealloc_frames((void *)shm[p->shared_memory.key].base, n_pages);
-		}
+/*** Remove the mapping of a shared memory area ***/
+// Removes the first n_pages pages of object s mapped at <addr> and
+// drops references to the shared frames; frames get deallocated
+// only after the last mapping is removed
+void unmap_shm(PCB *p, SHMEM *s, uint32_t addr, uint32_t n_pages) {
+	uint32_t i;
+	PTE *pte;
+
+	for (i=0; i<n_pages; i++) {
+		pte = get_pte(p, addr + i*4096);
+		if (pte == NULL) continue;
+
+		if ((*pte & 0xFFFFF000) == s->frames[i] && (uint32_t)(*pte & PTE_PRESENT) != 0)
+			dealloc_frames((void *)(*pte & 0xFFFFF000), 1);
+		*pte = 0;
+		invalidate_page(addr + i*4096);
 	}
 }
 
-/*** Free shared memory area ***/
-// Space allocated to a shared memory object is deleted when
-// the reference count becomes zero
+/*** Free shared memory areas ***/
+// Process p is detached from all its areas; space allocated to a
+// shared memory object is deleted when the reference count becomes zero
 void free_shared_memory(PCB *p) {
-	if (p->shared_memory.created) { // if process attached to a shared memory object
-		shm_detach(p);
-	}
+	while (p->shared_memory.n > 0)
+		shm_detach(p->shared_memory.segment[p->shared_memory.n-1].addr, p);
 }
-
@@ -0,0 +1,61 @@
+#include "../lib.h"
+
+// Wait on multiple objects: run this program twice. The first
+// instance waits on two semaphores at once, with a timeout, and
+// prints which one fired; the second instance signals them in
+// turns, pausing now and then so that timeouts happen too
+
+#define SM_KEY 		78
+#define ROUNDS		10
+
+typedef struct {
+	volatile uint32_t role;		// next role to assign
+	sem_t s[2];
+} SHARED_DATA;
+
+void main() {
+	uint32_t i, role, r;
+	WAIT_OBJECT objs[2];
+
+	SHARED_DATA *b = (SHARED_DATA *)smattach(SM_KEY, SM_READ_WRITE);
+	if (b == NULL) { // first instance
+		b = (SHARED_DATA *)smcreate(SM_KEY, sizeof(SHARED_DATA));
+		if (b == NULL) {
+			printf("Unable to create shared memory area.\n");
+			return;
+		}
+		b->s[0] = screate(0);
+		b->s[1] = screate(0);
+		if (b->s[0] == 0 || b->s[1] == 0) {
+			smdetach(b);
+			printf("Unable to create semaphore objects.\n");
+			return;
+		}
+	}
+
+	role = atomic_add(&b->role, 1);
+
+	if (role == 0) { // waiter
+		objs[0].type = WAIT_SEMAPHORE; objs[0].key = b->s[0];
+		objs[1].type = WAIT_SEMAPHORE; objs[1].key = b->s[1];
+		printf("[waiter] Run this program once more.\n");
+
+		for (i=0; i<2*ROUNDS; ) {
+			r = wait_any(objs, 2, 1000);
+			if (r == WAIT_TIMEOUT) printf("[waiter] Timeout.\n");
+			else if (r == WAIT_ERROR) { printf("[waiter] Error.\n"); break; }
+			else { printf("[waiter] Semaphore %u fired.\n", r); i++; }
+		}
+		while (b->role < 3) sleep(100); // keep semaphores alive
+	}
+	else { // signaller
+		for (i=0; i<ROUNDS; i++) {
+			sup(b->s[i % 2]);
+			sup(b->s[(i / 2) % 2]);
+			if (i % 4 == 3) sleep(1500);
+		}
+		atomic_add(&b->role, 1);
+	}
+
+	smdetach(b);
+}
@@ -0,0 +1,57 @@
+#include "../lib.h"
+
+// Message passing: run this program twice. The first instance is a
+// server that adds up the numbers it is sent; the second is a client
+// that calls the server (its pid is published in a named shared memory
+// area) and checks the replies. The last call asks the server to stop
+
+#define SM_NAME 	"p11.server"
+#define ROUNDS		1000
+
+#define OP_ADD		1
+#define OP_STOP		2
+
+typedef struct {
+	volatile uint32_t server;	// pid of the server + 1 (0: none yet)
+} SHARED_DATA;
+
+void main() {
+	uint32_t i, client, total = 0;
+	IPC_MSG msg;
+
+	SHARED_DATA *b = (SHARED_DATA *)smopen(SM_NAME, sizeof(SHARED_DATA), SM_READ_WRITE);
+	if (b == NULL) {
+		printf("Unable to open shared memory area.\n");
+		return;
+	}
+
+	if (atomic_cmpxchg(&b->server, 0, getpid() + 1) == 0) { // server
+		printf("[server] Run this program once more.\n");
+		client = ipc_receive(IPC_ANY, &msg);
+		while (client != IPC_ERROR && msg.w[0] == OP_ADD) {
+			total += msg.w[1];
+			msg.w[0] = total;
+			client = ipc_reply_wait(client, &msg);
+		}
+		if (client != IPC_ERROR) ipc_reply(client, &msg);
+		printf("[server] Total %u.\n", total);
+		smdetach(b);
+		smunlink(SM_NAME);
+	}
+	else { // client
+		for (i=1; i<=ROUNDS; i++) {
+			msg.w[0] = OP_ADD;
+			msg.w[1] = i;
+			if (ipc_call(b->server - 1, &msg) == IPC_ERROR) {
+				printf("[client] Server is gone.\n");
+				break;
+			}
+			total += i;
+			if (msg.w[0] != total) printf("[client] Bad reply %u (%u).\n", msg.w[0], total);
+		}
+		msg.w[0] = OP_STOP;
+		ipc_call(b->server - 1, &msg);
+		printf("[client] %u calls done.\n", i - 1);
+		smdetach(b);
+	}
+}
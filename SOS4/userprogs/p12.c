@@ -0,0 +1,66 @@
+#include "../lib.h"
+
+// Barrier benchmark: start 32 copies of this program at once (third
+// argument of run). The copies meet at barriers for 2, 4, 8, 16 and
+// then all 32 of them, and the first copy prints how many barrier
+// rounds per second each group manages
+
+#define SM_NAME 	"p12.barriers"
+#define NPROCS		32
+#define NGROUPS		5	// groups of 2, 4, ..., NPROCS processes
+#define ROUNDS		200
+
+typedef struct {
+	volatile uint32_t joined;	// copies started so far
+	volatile uint32_t ready;	// barriers created?
+	barrier_t group[NGROUPS];	// barrier of each group
+	barrier_t all;			// barrier of everybody, between groups
+} SHARED_DATA;
+
+void main() {
+	uint32_t rank, g, n, i, start, ms;
+
+	SHARED_DATA *b = (SHARED_DATA *)smopen(SM_NAME, sizeof(SHARED_DATA), SM_READ_WRITE);
+	if (b == NULL) {
+		printf("Unable to open shared memory area.\n");
+		return;
+	}
+
+	rank = atomic_add(&b->joined, 1);
+	if (rank >= NPROCS) {
+		smdetach(b);
+		return;
+	}
+
+	if (rank == 0) {
+		for (g=0, n=2; g<NGROUPS; g++, n*=2) b->group[g] = bcreate(n);
+		b->all = bcreate(NPROCS);
+		memory_barrier();
+		b->ready = 1;
+	}
+	else while (b->ready == 0) sleep(10);
+
+	for (g=0, n=2; g<NGROUPS; g++, n*=2) {
+		bwait(b->all); // everybody has finished the previous group
+		if (rank >= n) continue;
+
+		start = uptime();
+		for (i=0; i<ROUNDS; i++) bwait(b->group[g]);
+		ms = uptime() - start;
+
+		if (rank == 0) {
+			if (ms == 0) ms = 1;
+			printf("%u processes: %u rounds in %u ms (%u rounds/s)\n",
+				n, ROUNDS, ms, ROUNDS*1000/ms);
+		}
+	}
+	bwait(b->all);
+
+	if (rank == 0) {
+		for (g=0; g<NGROUPS; g++) bdestroy(b->group[g]);
+		bdestroy(b->all);
+		smdetach(b);
+		smunlink(SM_NAME);
+	}
+	else smdetach(b);
+}
@@ -0,0 +1,50 @@
+#include "../lib.h"
+
+// Named shared memory persistence test: an area is created and
+// filled, then detached, so that nobody is attached to it; other
+// memory is allocated meanwhile (which would reuse the frames if the
+// area had lost them), and the area is opened again by name and its
+// contents checked
+
+#define SM_NAME		"p13.persist"
+#define SIZE		(3*4096)	// bytes in the area (three pages)
+#define OTHER_SIZE	(16*4096)	// bytes of the other area
+
+void main() {
+	uint32_t i, bad = 0;
+	uint32_t *a, *other;
+
+	smunlink(SM_NAME); // left over by an earlier run, if any
+
+	a = (uint32_t *)smopen(SM_NAME, SIZE, SM_READ_WRITE);
+	if (a == NULL) {
+		printf("Unable to create shared memory area.\n");
+		return;
+	}
+	for (i=0; i<SIZE/4; i++) a[i] = i*2654435761u;
+	smdetach(a);
+	printf("Area written and detached.\n");
+
+	// memory freed by the detach (if any) goes to this area
+	other = (uint32_t *)smopen("p13.other", OTHER_SIZE, SM_READ_WRITE);
+	if (other != NULL)
+		for (i=0; i<OTHER_SIZE/4; i++) other[i] = 0xDEADBEEF;
+
+	a = (uint32_t *)smopen(SM_NAME, 0, SM_READ_ONLY);
+	if (a == NULL) {
+		printf("FAILED: area is gone.\n");
+		return;
+	}
+	for (i=0; i<SIZE/4; i++)
+		if (a[i] != i*2654435761u) bad++;
+
+	if (bad == 0) printf("OK: contents kept while nobody was attached.\n");
+	else printf("FAILED: %u of %u words changed.\n", bad, SIZE/4);
+
+	smdetach(a);
+	smunlink(SM_NAME);
+	if (other != NULL) {
+		smdetach(other);
+		smunlink("p13.other");
+	}
+}
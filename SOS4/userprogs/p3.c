@@ -1,88 +1,69 @@
 #include "../lib.h"
 
-#define SM_KEY 		36
-#define BUFFER_SIZE 	5
+#define SM_NAME 	"p3.ring"
+#define BUFFER_SIZE 	8	// slots in the ring (power of two)
+#define BULK_ITEMS	100000	// values sent without delay (benchmark)
+#define CLOSED		0x80000000	// in n_consumers: no more consumers may join
 
+// The shared memory area begins with the ring buffer (see lib.h);
+// the control data follows it
 typedef struct {
-	char slot[BUFFER_SIZE];
-	int in, out;
-	int n_consumers;
-	mutex_t mx_buffer;
-	mutex_t mx_consumer_count;
-	sem_t sem_empty;
-	sem_t sem_full;
-	sem_t sem_done;
-} SHARED_DATA;
+	volatile uint32_t n_consumers;	// consumers started so far (and CLOSED)
+	volatile uint32_t bulk_received;	// bulk values received by all consumers
+	fsem_t sem_done;		// consumers signal their end
+} CONTROL;
 
 void main() {
 	char str[] = "It looked like a good thing: but wait till I tell you. We were down South, in Alabama--Bill Driscoll and myself-when this kidnapping idea struck us. It was, as Bill afterward expressed it, \"during a moment of temporary mental apparition\"; but we didn't find that out till later.\n";
 
 	int i = 0;
-	SHARED_DATA *b = (SHARED_DATA *)smcreate(SM_KEY, sizeof(SHARED_DATA));
+	uint32_t alive;
+	uint32_t start, ms;
+	RING *r = (RING *)smopen(SM_NAME, ring_size(BUFFER_SIZE) + sizeof(CONTROL), SM_READ_WRITE);
+	CONTROL *c = (CONTROL *)((uint8_t *)r + ring_size(BUFFER_SIZE));
 
-	if (b==NULL) {
+	if (r==NULL) {
 		printf("Unable to create shared memory area.\n");
 		return;
 	}
 
-	b->sem_empty = screate(BUFFER_SIZE);
-	b->sem_full = screate(0);
-	b->sem_done = screate(0);
+	// the ring and its futex words live in the shared memory area;
+	// the kernel is involved only when a process has to wait
+	ring_init(r, BUFFER_SIZE);
+	c->n_consumers = 0;
+	c->bulk_received = 0;
+	fsinit(&c->sem_done, 0);
 
-	if (b->sem_empty == 0 || b->sem_full == 0 || b->sem_done == 0) { 
-		smdetach();
-		printf("Unable to create semaphore objects.\n");
-		return;
-	}
-
-	b->mx_buffer = mcreate();
-	b->mx_consumer_count = mcreate();
-
-	if (b->mx_buffer == 0 || b->mx_consumer_count == 0) {
-		smdetach();
-		printf("Unable to create mutex objects.\n");
-		return;
-	}
-
-	b->in = 0; b->out = 0; b->n_consumers = 0;
 	printf("Producing items...consumers can run now.\n");
 
 	while(str[i]!=0) {
 		sleep(50); // simulation: producer producing next item
-	  	sdown(b->sem_empty);
-		// begin critical section
-   		b->slot[b->in] = str[i];
-		b->in = (b->in+1)%BUFFER_SIZE;
-		// end critical section
-	  	sup(b->sem_full);
+		mpmc_put(r, (uint8_t)str[i]);
 		i++;
 	} 
 
+	// benchmark: values (256 onwards, never a character) are sent as
+	// fast as consumers can take them; timed until all consumers end
+	start = uptime();
+	for (i=0; i<BULK_ITEMS; i++) mpmc_put(r, 256+i);
+
 	printf("\nDone producing...waiting for consumers to end.\n");
 
-	mlock(b->mx_consumer_count);
-	int alive;
-	
-	do {
-		mlock(b->mx_buffer);
-		alive = b->n_consumers;
-		munlock(b->mx_buffer);
-		
-		if (alive > 0) { // consumers are alive
-			sdown(b->sem_empty);
-			b->slot[b->in] = 0; // send END signal to consumer
-			b->in = (b->in+1)%BUFFER_SIZE;
-			sup(b->sem_full);
-			sdown(b->sem_done);
-		}
-	} while (alive>0);
+	// consumers started from now on leave without taking anything;
+	// the count of the others is the value before closing
+	alive = atomic_add(&c->n_consumers, CLOSED);
+
+	// one END signal (0) for each consumer
+	for (i=0; i<alive; i++) mpmc_put(r, 0);
+	for (i=0; i<alive; i++) fsdown(&c->sem_done);
+	ms = uptime() - start;
+	if (ms == 0) ms = 1;
 	
-	printf("\nShutters down!\n");
+	printf("\n%u bulk items sent, %u received by %u consumers.\n", 
+		BULK_ITEMS, c->bulk_received, alive);
+	printf("%u ms (%u items/s)\n", ms, BULK_ITEMS*1000/ms);
+	printf("Shutters down!\n");
 
-	sdestroy(b->sem_full);
-	sdestroy(b->sem_empty);
-	sdestroy(b->sem_done);
-	mdestroy(b->mx_buffer);
-	mdestroy(b->mx_consumer_count);
-	smdetach();
+	smdetach(r);
+	smunlink(SM_NAME);
 }
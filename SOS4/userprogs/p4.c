@@ -1,57 +1,47 @@
 #include "../lib.h"
 
-#define SM_KEY 		36
-#define BUFFER_SIZE 	5
+#define SM_NAME 	"p3.ring"
+#define BUFFER_SIZE 	8	// slots in the ring (power of two)
+#define CLOSED		0x80000000	// in n_consumers: no more consumers may join
 
+// The shared memory area begins with the ring buffer (see lib.h);
+// the control data follows it
 typedef struct {
-	char slot[BUFFER_SIZE];
-	int in, out;
-	int n_consumers;
-	mutex_t mx_buffer;
-	mutex_t mx_consumer_count;
-	sem_t sem_empty;
-	sem_t sem_full;
-	sem_t sem_done;
-} SHARED_DATA;
+	volatile uint32_t n_consumers;	// consumers started so far (and CLOSED)
+	volatile uint32_t bulk_received;	// bulk values received by all consumers
+	fsem_t sem_done;		// consumers signal their end
+} CONTROL;
 
 void main() {
-	int i;
-	char c;
+	uint32_t v;
+	uint32_t received = 0;
 
-	SHARED_DATA *b = (SHARED_DATA *)smattach(SM_KEY, SM_READ_WRITE);
-	if (b==NULL) {
+	RING *r = (RING *)smopen(SM_NAME, 0, SM_READ_WRITE);
+	CONTROL *c = (CONTROL *)((uint8_t *)r + ring_size(BUFFER_SIZE));
+	if (r==NULL) {
 		printf("No memory area to attach to.\n");
 		return;
 	}
 
-	// TODO: Check that semaphore and mutex objects have been created
-
-	mlock(b->mx_consumer_count);
-	b->n_consumers++;
-	munlock(b->mx_consumer_count);
+	// too late if the producer is already shutting down
+	if (atomic_add(&c->n_consumers, 1) & CLOSED) {
+		printf("Producer is done.\n");
+		smdetach(r);
+		return;
+	}
 
 	do {
-		sdown(b->sem_full);
-		mlock(b->mx_buffer);
-
-		// begin critical section
-   		c = b->slot[b->out];
-		b->out = (b->out+1)%BUFFER_SIZE;
-		if (c==0) {
-			b->n_consumers--;
-			munlock(b->mx_buffer);
-			sup(b->sem_empty);
-			break;
-		}
-		// end critical section
-
-	  	munlock(b->mx_buffer);
-		sup(b->sem_empty);
+		v = mpmc_get(r);
+		if (v == 0) break; // END signal
 
-		printf("%c",c);
-		sleep(300); // simulation: consumer using item
+		if (v < 256) { // a character
+			printf("%c",v);
+			sleep(300); // simulation: consumer using item
+		}
+		else received++; // bulk value
 	} while (TRUE);
 
-	sup(b->sem_done);
-	smdetach();
-  }
+	atomic_add(&c->bulk_received, received);
+	fsup(&c->sem_done);
+	smdetach(r);
+}
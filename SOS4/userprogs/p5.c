@@ -1,6 +1,6 @@
 #include "../lib.h"
 
-#define SM_KEY 		123
+#define SM_NAME 	"hello-world"
 
 
 typedef struct {
@@ -10,7 +10,7 @@ typedef struct {
 
 void main() {
 	int i;
-	SEM *b = (SEM *)smcreate(SM_KEY, sizeof(SEM));
+	SEM *b = (SEM *)smopen(SM_NAME, sizeof(SEM), SM_READ_WRITE);
 
 	b->hello = screate(1);
 	b->world = screate(0);
@@ -24,5 +24,6 @@ void main() {
 	sleep(1000);
 	sdestroy(b->hello);
 	sdestroy(b->world);
-	smdetach();
+	smdetach(b);
+	smunlink(SM_NAME);
 }
@@ -1,6 +1,6 @@
 #include "../lib.h"
 
-#define SM_KEY 		123
+#define SM_NAME 	"hello-world"
 
 
 typedef struct {
@@ -10,7 +10,7 @@ typedef struct {
 
 void main() {
 	int i;
-	SEM *b = (SEM *)smattach(SM_KEY, SM_READ_WRITE);
+	SEM *b = (SEM *)smopen(SM_NAME, 0, SM_READ_WRITE);
 	
 	for (i=0; i<10; i++) {
 		sdown(b->world);
@@ -19,5 +19,5 @@ void main() {
 	}
 
 	sleep(1000);
-	smdetach();
+	smdetach(b);
 }
@@ -0,0 +1,78 @@
+#include "../lib.h"
+
+// Priority inheritance test: run this program three times; the
+// first instance (low priority) locks a mutex, waits until the
+// other two have started and then works with it, the second one (medium priority) hogs the CPU, and the third
+// one (high priority) waits for the mutex. Without priority
+// inheritance the low priority holder never runs while the
+// medium one is busy, and the high priority one waits until the
+// medium one is done; with it, the holder runs at high priority
+// and the medium one makes (almost) no progress while the high
+// priority process waits
+
+#define SM_KEY 		77
+#define WORK		2000000
+#define HOG		50000000
+
+typedef struct {
+	volatile uint32_t role;		// next role to assign
+	volatile uint32_t mid_progress;	// work done by the medium priority process
+	volatile bool high_done;	// high priority process got the lock
+	mutex_t m;
+} SHARED_DATA;
+
+void main() {
+	uint32_t i, role, before;
+	volatile uint32_t work = 0;
+
+	SHARED_DATA *b = (SHARED_DATA *)smattach(SM_KEY, SM_READ_WRITE);
+	if (b == NULL) { // first instance
+		b = (SHARED_DATA *)smcreate(SM_KEY, sizeof(SHARED_DATA));
+		if (b == NULL) {
+			printf("Unable to create shared memory area.\n");
+			return;
+		}
+		b->m = mcreate();
+		if (b->m == 0) {
+			smdetach(b);
+			printf("Unable to create mutex object.\n");
+			return;
+		}
+		b->mid_progress = 0;
+		b->high_done = FALSE;
+	}
+
+	role = atomic_add(&b->role, 1);
+
+	if (role == 0) { // low priority: holds the mutex for a while
+		setpriority(1);
+		mlock(b->m);
+		printf("[low] Locked; run this program two more times.\n");
+		// keep the lock until the others have started, so that the
+		// high priority one has to wait for it
+		while (b->role < 3) sleep(10);
+		for (i=0; i<WORK; i++) work++;
+		for (i=0; i<WORK; i++) work++;
+		munlock(b->m);
+		printf("[low] Unlocked.\n");
+		while (!b->high_done) sleep(100); // keep the mutex alive
+	}
+	else if (role == 1) { // medium priority: CPU hog
+		setpriority(4);
+		printf("[medium] Running.\n");
+		for (i=0; i<HOG && !b->high_done; i++) b->mid_progress++;
+		printf("[medium] Done.\n");
+	}
+	else { // high priority: needs the mutex
+		setpriority(7);
+		before = b->mid_progress;
+		printf("[high] Waiting for lock.\n");
+		mlock(b->m);
+		printf("[high] Locked; medium made %u steps while I waited.\n",
+			b->mid_progress - before);
+		munlock(b->m);
+		b->high_done = TRUE;
+	}
+
+	smdetach(b);
+}
@@ -0,0 +1,27 @@
+#include "../lib.h"
+
+// Pipe source: run as the first program of a pipeline, e.g.
+//   run 1900 <sectors> | run 2000 <sectors>
+// Writes a few lines of text and then two whole pages; the pages
+// are page aligned, so they are given to the pipe without copying
+
+#define N_PAGES		2
+
+void main() {
+	char text[] = "It looked like a good thing: but wait till I tell you.\n";
+	char area[(N_PAGES+1)*4096];
+	char *pages = (char *)(((uint32_t)area + 4095) & ~4095); // page aligned
+	int i, n;
+
+	for (n=0; text[n]!=0; n++);
+	for (i=0; i<3; i++) {
+		if (pwrite(text, n) != n) {
+			printf("[source] Nobody is reading.\n");
+			return;
+		}
+	}
+
+	for (i=0; i<N_PAGES*4096; i++) pages[i] = '0' + (i/4096); // digits; text has none
+	if (pwrite(pages, N_PAGES*4096) != N_PAGES*4096) 
+		printf("[source] Nobody is reading.\n");
+}
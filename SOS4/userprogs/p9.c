@@ -0,0 +1,27 @@
+#include "../lib.h"
+
+// Pipe sink: run as the last program of a pipeline (see p8.c);
+// prints text and counts the digits (page content) received
+
+void main() {
+	char area[2*4096];
+	char *buf = (char *)(((uint32_t)area + 4095) & ~4095); // page aligned
+	uint32_t counts[10];
+	uint32_t i, n;
+	uint32_t total = 0;
+
+	for (i=0; i<10; i++) counts[i] = 0;
+
+	while ((n = pread(buf, 4096)) != 0) {
+		total += n;
+		for (i=0; i<n; i++) {
+			if (buf[i] >= '0' && buf[i] <= '9') counts[buf[i]-'0']++;
+			else printf("%c", buf[i]); // text
+		}
+	}
+
+	printf("[sink] %u bytes received", total);
+	for (i=0; i<10; i++) 
+		if (counts[i] != 0) printf(", %u x '%c'", counts[i], '0'+i);
+	printf(".\n");
+}
@@ -0,0 +1,127 @@
+///////////////////////////////////////////////////////
+// Waiting on many objects at once
+// A process can wait on a set of up to WAIT_MAXOBJECTS semaphores,
+// mutexes and its input pipe, optionally with a timeout; it is woken
+// up by the first object that fires, which is then obtained for it
+// (semaphore DOWN, mutex locked; a pipe is only reported readable)
+// One wait node of the process (see PCB) is put in the queue of
+// each object; a node in a queue is handled like any other waiter,
+// and when it is served (wait_any_fired) the other nodes of the
+// process are taken out of their queues
+
+#include "kernel_only.h"
+
+/*** Wait on any of n objects ***/
+// Returns TRUE if an object can be obtained at once; its index in
+// objs[] (or WAIT_ERROR if the set is invalid) is put in *index.
+// Otherwise p is queued on all objects and FALSE is returned; tts
+// is the timeout in milliseconds (0 for none)
+bool wait_objects(PCB *p, WAIT_OBJECT *objs, uint32_t n, uint32_t tts, uint32_t *index) {
+	uint32_t i;
+	QUEUE *q;
+
+	*index = WAIT_ERROR;
+	if (n == 0 || n > WAIT_MAXOBJECTS) return TRUE;
+
+	// anything available now?
+	for (i=0; i<n; i++) {
+		switch (objs[i].type) {
+			case WAIT_SEMAPHORE:
+				if (semaphore_queue(objs[i].key) == NULL) return TRUE;
+				if (semaphore_trydown(objs[i].key)) { *index = i; return TRUE; }
+				break;
+			case WAIT_MUTEX:
+				if (mutex_queue(objs[i].key) == NULL) return TRUE;
+				if (mutex_trylock(objs[i].key, p)) { *index = i; return TRUE; }
+				break;
+			case WAIT_PIPE:
+				if (pipe_read_queue(p) == NULL) return TRUE;
+				if (pipe_readable(p)) { *index = i; return TRUE; }
+				break;
+			default:
+				return TRUE;
+		}
+	}
+
+	// wait on all of them
+	for (i=0; i<n; i++) {
+		switch (objs[i].type) {
+			case WAIT_SEMAPHORE: q = semaphore_queue(objs[i].key); break;
+			case WAIT_MUTEX: q = mutex_queue(objs[i].key); break;
+			default: q = pipe_read_queue(p); break;
+		}
+
+		p->wait_any.object[i] = objs[i];
+		p->wait_any.queue[i] = q;
+		p->wait_any.node[i].p = p;
+		p->wait_any.node[i].index = i;
+		enqueue(q, &p->wait_any.node[i]);
+
+		if (objs[i].type == WAIT_MUTEX) // holder should not be kept from running
+			inherit_priority(mutex_owner(objs[i].key), p->priority.effective);
+	}
+	p->wait_any.n = n;
+
+	if (tts != 0) p->sleep_end = get_epochs() + tts/get_epoch_length() + 1; // never 0
+	return FALSE;
+}
+
+/*** An object of a wait_any set fired ***/
+// node has already been taken out of its queue (and the object
+// obtained) by the process that made the object available
+void wait_any_fired(WAIT_NODE *node) {
+	PCB *p = node->p;
+
+	remove_wait_any(p, node);
+
+	p->cpu.edx = node->index; // return value
+	p->sleep_end = 0; // cancel timeout, if any
+	p->state = READY;
+}
+
+/*** An object of a wait_any set was destroyed ***/
+// node has already been taken out of its queue; the wait ends
+// without obtaining anything
+void wait_any_cancel(WAIT_NODE *node) {
+	PCB *p = node->p;
+
+	remove_wait_any(p, node);
+
+	p->cpu.edx = WAIT_ERROR; // return value
+	p->sleep_end = 0; // cancel timeout, if any
+	p->state = READY;
+}
+
+/*** Timeout of a wait_any set ***/
+// Called by the scheduler when the timeout is over
+void wait_any_timeout(PCB *p) {
+	remove_wait_any(p, NULL);
+	p->cpu.edx = WAIT_TIMEOUT; // return value
+}
+
+/*** Take wait nodes of process p out of their queues ***/
+// except node <fired>, which is already out; holders of mutexes
+// no longer waited on may drop priority inherited from p, and
+// processes queued behind p on a semaphore may now be served
+void remove_wait_any(PCB *p, WAIT_NODE *fired) {
+	uint32_t i;
+	PCB *holder;
+
+	for (i=0; i<p->wait_any.n; i++) {
+		if (&p->wait_any.node[i] == fired) continue;
+		remove_queue_item(p->wait_any.queue[i], &p->wait_any.node[i]);
+
+		if (p->wait_any.object[i].type == WAIT_MUTEX) {
+			holder = mutex_owner(p->wait_any.object[i].key);
+			if (holder != NULL) update_priority(holder);
+		}
+		else if (p->wait_any.object[i].type == WAIT_SEMAPHORE)
+			semaphore_up_n(p->wait_any.object[i].key, 0, p);
+	}
+	p->wait_any.n = 0;
+}
+
+/*** Cleanup wait_any set for a process ***/
+void free_wait_any(PCB *p) {
+	if (p->wait_any.n != 0) remove_wait_any(p, NULL);
+}